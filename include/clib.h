@@ -11,6 +11,7 @@
 #include "clib_stream.h"
 #include "clib_string.h"
 #include "clib_buffer.h"
+#include "clib_arena.h"
 #include "clib_hashmap.h"
 
 #endif
@@ -0,0 +1,21 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+#ifndef CLIB_ARENA_H
+#define CLIB_ARENA_H
+
+#include <stddef.h>
+
+typedef struct arena { struct arena_block *head; size_t size; } arena_t;
+
+arena_t *arena_create(size_t);
+void *arena_alloc(arena_t *, size_t);
+size_t arena_used(const arena_t *);
+void arena_clear(arena_t *);
+void arena_destroy(arena_t *);
+void arena_free(void *);
+
+#endif
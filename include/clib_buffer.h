@@ -14,6 +14,7 @@ enum { BUFFER_ERROR_RESIZE = 1, BUFFER_ERROR_FORMAT };
 
 buffer_t *buffer_create(void);
 char *buffer_resize(buffer_t *, size_t);
+char *buffer_reserve(buffer_t *, size_t);
 char *buffer_repeat(buffer_t *, char, size_t);
 char *buffer_insert(buffer_t *, size_t, const char *, size_t);
 char *buffer_append(buffer_t *, const char *, size_t);
@@ -0,0 +1,20 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+#ifndef CLIB_NUMBER_H
+#define CLIB_NUMBER_H
+
+#include <stddef.h>
+
+/* Longest output of number_format: -d.ddddddddddddddde-ddd plus '\0' */
+#define NUMBER_FORMAT_SIZE 25
+
+/* Strict JSON grammar, unlike strtod: "01", "-00" and "1." are rejected */
+int number_parse(const char **, const char *, double *, int *);
+size_t number_format(char *, double);
+size_t integer_format(char *, double);
+
+#endif
@@ -7,7 +7,19 @@
 #ifndef CLIB_REGEX_H
 #define CLIB_REGEX_H
 
+#include <stddef.h>
+
+typedef struct pattern pattern_t;
+
 int test_regex(const char *, const char *);
+pattern_t *pattern_create(const char *);
+int pattern_test(const pattern_t *, const char *);
+void pattern_destroy(pattern_t *);
+void regex_cache_resize(size_t);
+void regex_cache_clear(void);
+size_t regex_cache_size(void);
+size_t regex_cache_hits(void);
+size_t regex_cache_misses(void);
 
 #endif
 
@@ -0,0 +1,13 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+#ifndef CLIB_SCAN_H
+#define CLIB_SCAN_H
+
+const char *scan_spaces(const char *, const char *);
+const char *scan_quotes(const char *, const char *);
+
+#endif
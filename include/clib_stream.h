@@ -7,11 +7,16 @@
 #ifndef CLIB_STREAM_H
 #define CLIB_STREAM_H
 
+#include <stddef.h>
+
 enum { FILE_WRITE, FILE_APPEND };
 
 int file_exists(const char *);
 char *file_read(const char *);
 char *file_read_callback(const char *, char *(*)(void *, size_t), void *);
+const char *file_map(const char *, size_t *);
+const char *file_map_random(const char *, size_t *);
+void file_unmap(const char *, size_t);
 int file_write(const char *, const char *);
 int file_write_bytes(const char *, const char *, size_t);
 int file_append(const char *, const char *);
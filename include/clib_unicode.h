@@ -62,6 +62,7 @@ char encode_esc(const char *);
 int is_hex(const char *);
 size_t decode_hex(const char *, char *);
 size_t encode_hex(const char *, char *);
+size_t decode_string(char *, const char *, const char *);
 int hex_to_dec(int);
 
 #endif
@@ -8,9 +8,15 @@
 #define JSON_H
 
 #include "json_parser.h"
+#include "json_stream.h"
+#include "json_lines.h"
 #include "json_reader.h"
 #include "json_writer.h"
+#include "json_keys.h"
+#include "json_columns.h"
 #include "json_buffer.h"
+#include "json_binary.h"
+#include "json_view.h"
 #include "json_schema.h"
 #include "json_utils.h"
 
@@ -0,0 +1,18 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+#ifndef JSON_BINARY_H
+#define JSON_BINARY_H
+
+#include <stddef.h>
+#include "clib_buffer.h"
+#include "json_header.h"
+
+char *json_encode_binary(buffer_t *, const json_t *);
+json_t *json_decode_binary(const char *, size_t);
+
+#endif
+
@@ -13,13 +13,23 @@
 
 enum json_encoding { JSON_UTF8, JSON_ASCII };
 
+typedef struct json_sink json_sink_t;
+typedef int (*json_write_callback)(const char *, size_t, void *);
+
 enum json_encoding json_get_encoding(void);
 void json_set_encoding(enum json_encoding);
+size_t json_encoded_size(const json_t *, size_t);
 char *json_encode(const json_t *, size_t);
 char *json_buffer_encode(buffer_t *, const json_t *, size_t);
 char *json_stringify(const json_t *);
 int json_write(const json_t *, FILE *, size_t);
+int json_write_fd(const json_t *, int, size_t);
+int json_write_stream(const json_t *, size_t, json_write_callback, void *);
 int json_write_line(const json_t *, FILE *);
+json_sink_t *json_sink_create(int, size_t, size_t);
+int json_sink_write(json_sink_t *, const json_t *);
+int json_sink_flush(json_sink_t *);
+int json_sink_close(json_sink_t *);
 int json_write_file(const json_t *, const char *, size_t);
 int json_print(const json_t *);
 char *json_quote(const char *);
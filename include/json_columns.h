@@ -0,0 +1,32 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+#ifndef JSON_COLUMNS_H
+#define JSON_COLUMNS_H
+
+#include <stddef.h>
+#include "json_header.h"
+
+typedef struct json_columns json_columns_t;
+
+json_columns_t *json_columns_create(const json_t *, const char *[], size_t);
+size_t json_columns_rows(const json_columns_t *);
+size_t json_columns_size(const json_columns_t *);
+const char *json_columns_name(const json_columns_t *, size_t);
+unsigned json_columns_index(const json_columns_t *, const char *);
+unsigned json_columns_type(const json_columns_t *, size_t);
+const double *json_columns_numbers(const json_columns_t *, size_t);
+double json_columns_sum(const json_columns_t *, size_t);
+const unsigned *json_columns_ids(const json_columns_t *, size_t);
+const char *json_columns_symbol(const json_columns_t *, unsigned);
+unsigned json_columns_lookup(const json_columns_t *, const char *);
+int json_columns_boolean(const json_columns_t *, size_t, size_t);
+int json_columns_is_null(const json_columns_t *, size_t, size_t);
+json_t *json_columns_tree(const json_columns_t *);
+void json_columns_destroy(json_columns_t *);
+
+#endif
+
@@ -0,0 +1,21 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+#ifndef JSON_KEYS_H
+#define JSON_KEYS_H
+
+#include <stddef.h>
+#include "clib_hashmap.h"
+
+typedef map_t json_keys_t;
+
+json_keys_t *json_keys_create(size_t);
+void json_keys_destroy(json_keys_t *);
+size_t json_keys_size(const json_keys_t *);
+void json_set_keys(json_keys_t *);
+json_keys_t *json_get_keys(void);
+
+#endif
@@ -0,0 +1,20 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+#ifndef JSON_LINES_H
+#define JSON_LINES_H
+
+#include <stddef.h>
+#include "json_parser.h"
+
+typedef int (*json_lines_callback)(json_t *, size_t, void *);
+
+json_t *json_parse_lines(const char *, size_t, json_error_t *);
+json_t *json_parse_lines_file(const char *, json_error_t *);
+int json_parse_lines_callback(const char *, size_t, json_lines_callback, void *,
+    json_error_t *);
+
+#endif
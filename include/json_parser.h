@@ -7,14 +7,24 @@
 #ifndef JSON_PARSER_H
 #define JSON_PARSER_H
 
+#include "clib_arena.h"
 #include "json_header.h"
 
 typedef struct { int line, column; } json_error_t;
+typedef arena_t json_arena_t;
+typedef struct json_parser json_parser_t;
 
 void json_parser_set_max_depth(unsigned short);
 unsigned short json_parser_get_max_depth(void);
 json_t *json_parse(const char *, json_error_t *);
+json_t *json_parse_n(const char *, size_t, json_error_t *);
+json_t *json_parse_insitu(char *, json_error_t *);
+json_t *json_parse_arena(const char *, json_arena_t *, json_error_t *);
 json_t *json_parse_file(const char *, json_error_t *);
+json_parser_t *json_parser_create(void);
+int json_parser_feed(json_parser_t *, const char *, size_t);
+json_t *json_parser_finish(json_parser_t *, json_error_t *);
+void json_parser_destroy(json_parser_t *);
 void json_print_error(const json_error_t *);
 
 #endif
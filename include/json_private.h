@@ -7,15 +7,111 @@
 #ifndef JSON_PRIVATE_H
 #define JSON_PRIVATE_H
 
+#include <stddef.h>
+
 struct json
 {
     char *key;
     union { struct json **child; char *string; double number; };
     unsigned size;          // Size of an iterable (object/array)
     unsigned short flags;   // Available for user
-    unsigned char packed;   // 0 = Root node | 1 = Packed node
+    unsigned char packed;   // Bitmask (0 = Root node | JSON_PACKED = Packed node)
     unsigned char type;     // json_type compressed (1 byte)
 };
 
-#endif
+/**
+ * Bits of 'packed'
+ * JSON_BORROWED_* flag members pointing to memory not owned by the node
+ * (e.g. an arena) or stored in the same block right after the node, those
+ * members are not released on their own.
+ * JSON_DOCUMENT flags a root allocated as 'struct json_document'.
+ * JSON_INDEXED flags an object whose 'child' is preceded by a keymap.
+ * JSON_KEYED flags a key stored in a 'struct json_keyref'.
+ */
+enum
+{
+    JSON_PACKED = 0x01,
+    JSON_BORROWED_KEY = 0x02,
+    JSON_BORROWED_STRING = 0x04,
+    JSON_BORROWED_CHILD = 0x08,
+    JSON_BORROWED_NODE = 0x10,
+    JSON_BORROWED = JSON_BORROWED_KEY | JSON_BORROWED_STRING |
+                    JSON_BORROWED_CHILD | JSON_BORROWED_NODE,
+    JSON_DOCUMENT = 0x20,
+    JSON_INDEXED = 0x40,
+    JSON_KEYED = 0x80
+};
+
+/* Root of an in-situ document, 'source' is released along with the node */
+struct json_document
+{
+    struct json node;
+    char *source;
+};
 
+/* Objects with at least JSON_KEYMAP_MIN members are indexed by key */
+#define JSON_KEYMAP_MIN 32
+
+#define json_keymap_of(node) (((struct json_keymap **)(void *)(node)->child)[-1])
+
+/* Keys of members of indexed objects know their parent (see json_keymap.c) */
+struct json_keyref
+{
+    struct json *parent;    // Indexed object or NULL
+    char key[];
+};
+
+#define json_keyref_of(str) \
+    ((struct json_keyref *)(void *)((str) - offsetof(struct json_keyref, key)))
+
+/* Frames of the first levels are not allocated (see json_stack.c) */
+#define JSON_STACK_BASE 32
+
+struct json_frame
+{
+    const struct json *node, *peer;
+    unsigned index;
+};
+
+struct json_stack
+{
+    struct json_frame *frame;
+    size_t size, room;
+    struct json_frame base[JSON_STACK_BASE];
+};
+
+#define json_stack_top(stack) (&(stack)->frame[(stack)->size - 1])
+
+int json_stack_push(struct json_stack *, const struct json *, const struct json *);
+void json_stack_free(struct json_stack *);
+
+struct json_hashset
+{
+    const struct json *parent;
+    unsigned long *hashes;
+    unsigned *slots;    // Position + 1 (0 = empty slot)
+    size_t mask;        // Number of slots - 1
+};
+
+int json_hashset_init(struct json_hashset *, const struct json *);
+unsigned json_hashset_insert(struct json_hashset *, unsigned);
+unsigned json_hashset_find(const struct json_hashset *, const struct json *);
+void json_hashset_free(struct json_hashset *);
+
+struct arena;
+struct json_keymap;
+struct map;
+
+char *json_keys_intern(struct map *, const char *, size_t);
+
+struct json_keymap *json_keymap_create(struct json *, size_t, struct arena *);
+int json_keymap_attach(struct json *, size_t);
+void json_keymap_destroy(struct json *);
+void json_keymap_reset(struct json *);
+void json_keymap_insert(struct json *, unsigned);
+void json_keymap_remove(struct json *, unsigned);
+unsigned json_keymap_find(const struct json *, const char *, size_t);
+unsigned json_keymap_unlink(struct json *, const struct json *);
+void json_keymap_link(struct json *, unsigned);
+
+#endif
@@ -70,6 +70,7 @@ int json_regex(const json_t *, const char *);
 int json_is_unique(const json_t *, const json_t *);
 int json_unique_children(const json_t *);
 int json_equal(const json_t *, const json_t *);
+unsigned long json_hash(const json_t *);
 int json_walk(const json_t *, json_walk_callback, void *);
 
 #endif
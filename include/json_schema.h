@@ -33,12 +33,23 @@ typedef struct
 } json_event_t;
 
 typedef int (*json_validate_callback)(const json_event_t *, void *);
+typedef int (*json_batch_callback)(const json_event_t *, size_t, void *);
+
+typedef struct json_schema json_schema_t;
 
 void json_set_warning_mode(enum json_warning_mode);
 enum json_warning_mode json_get_warning_mode(void);
+void json_set_validate_threads(unsigned);
+unsigned json_get_validate_threads(void);
 char *json_write_event(buffer_t *, const json_event_t *);
 int json_validate(const json_t *, const json_t *, const map_t *,
     json_validate_callback, void *);
+json_schema_t *json_schema_compile(const json_t *, const map_t *);
+int json_schema_validate(const json_schema_t *, const json_t *,
+    json_validate_callback, void *);
+void json_schema_destroy(json_schema_t *);
+size_t json_validate_batch(const json_t *, const json_t * const [], size_t,
+    const map_t *, int [], unsigned, json_batch_callback, void *);
 
 #endif
 
@@ -0,0 +1,46 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <stddef.h>
+#include "json_parser.h"
+
+enum json_token
+{
+    JSON_TOKEN_ERROR,       // Syntax error, out of memory or read error
+    JSON_TOKEN_MORE,        // More input is needed (see json_stream_feed)
+    JSON_TOKEN_END,         // End of the document
+    JSON_TOKEN_OBJECT,
+    JSON_TOKEN_OBJECT_END,
+    JSON_TOKEN_ARRAY,
+    JSON_TOKEN_ARRAY_END,
+    JSON_TOKEN_KEY,
+    JSON_TOKEN_STRING,
+    JSON_TOKEN_INTEGER,
+    JSON_TOKEN_REAL,
+    JSON_TOKEN_TRUE,
+    JSON_TOKEN_FALSE,
+    JSON_TOKEN_NULL,
+};
+
+typedef struct json_stream json_stream_t;
+
+json_stream_t *json_stream_create(void);
+json_stream_t *json_stream_buffer(const char *, size_t);
+json_stream_t *json_stream_fd(int);
+int json_stream_feed(json_stream_t *, const char *, size_t);
+void json_stream_finish(json_stream_t *);
+enum json_token json_stream_next(json_stream_t *);
+const char *json_stream_text(const json_stream_t *);
+size_t json_stream_length(const json_stream_t *);
+double json_stream_number(const json_stream_t *);
+unsigned json_stream_depth(const json_stream_t *);
+int json_stream_error(const json_stream_t *, json_error_t *);
+void json_stream_destroy(json_stream_t *);
+
+#endif
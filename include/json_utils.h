@@ -7,8 +7,12 @@
 #ifndef JSON_UTILS_H
 #define JSON_UTILS_H
 
+#include <limits.h>
 #include "json_header.h"
 
+/* Returned by json_compare when deep levels can not be traversed */
+#define JSON_COMPARE_ERROR INT_MIN
+
 typedef int (*json_sort_callback)(const void *, const void *);
 
 int json_compare(const json_t *, const json_t *);
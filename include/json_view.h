@@ -0,0 +1,33 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+#ifndef JSON_VIEW_H
+#define JSON_VIEW_H
+
+#include <stddef.h>
+#include "clib_buffer.h"
+#include "json_header.h"
+
+typedef struct json_view json_view_t;
+
+char *json_view_encode(buffer_t *, const json_t *);
+int json_view_write_file(const json_t *, const char *);
+const json_view_t *json_view_root(const char *, size_t);
+const json_view_t *json_view_map(const char *);
+void json_view_unmap(const json_view_t *);
+enum json_type json_view_type(const json_view_t *);
+const char *json_view_key(const json_view_t *);
+const char *json_view_string(const json_view_t *);
+const char *json_view_text(const json_view_t *);
+double json_view_number(const json_view_t *);
+int json_view_boolean(const json_view_t *);
+unsigned json_view_size(const json_view_t *);
+const json_view_t *json_view_at(const json_view_t *, size_t);
+const json_view_t *json_view_find(const json_view_t *, const char *);
+const json_view_t *json_view_pointer(const json_view_t *, const char *);
+
+#endif
+
@@ -0,0 +1,140 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+/*
+--------------------------------------------------------
+Region allocator
+--------------------------------------------------------
+Memory is served from large blocks in a bump-pointer
+fashion and it is released all at once (arena_clear)
+
+- 'size' is the size of a regular block (0 = default)
+- Requests not fitting in a regular block get a block
+  of their own, linked behind the current one in order
+  to keep using the remaining space of the current one
+- A zero-initialized arena_t is ready to use
+--------------------------------------------------------
+*/
+
+#include <stdlib.h>
+#include <stdalign.h>
+#include "clib_arena.h"
+
+#define ARENA_BLOCK_SIZE 65536
+
+/* Pointers and doubles are the widest objects stored in an arena */
+typedef union { void *pointer; double number; long long integer; } align_t;
+
+#define ARENA_ALIGN alignof(align_t)
+
+struct arena_block
+{
+    struct arena_block *next;
+    size_t used, size;
+    align_t data[];
+};
+
+arena_t *arena_create(size_t size)
+{
+    arena_t *arena = calloc(1, sizeof *arena);
+
+    if (arena != NULL)
+    {
+        arena->size = size;
+    }
+    return arena;
+}
+
+static struct arena_block *new_block(size_t size)
+{
+    struct arena_block *block = malloc(sizeof *block + size);
+
+    if (block != NULL)
+    {
+        block->next = NULL;
+        block->used = 0;
+        block->size = size;
+    }
+    return block;
+}
+
+void *arena_alloc(arena_t *arena, size_t length)
+{
+    size_t size = (length + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    if ((size < length) || (size == 0))
+    {
+        return NULL;
+    }
+
+    struct arena_block *block = arena->head;
+
+    if ((block == NULL) || (block->size - block->used < size))
+    {
+        size_t room = arena->size ? arena->size : ARENA_BLOCK_SIZE;
+
+        if ((block = new_block(size > room ? size : room)) == NULL)
+        {
+            return NULL;
+        }
+        // Oversized requests don't replace the current block
+        if ((size > room) && (arena->head != NULL))
+        {
+            block->next = arena->head->next;
+            arena->head->next = block;
+        }
+        else
+        {
+            block->next = arena->head;
+            arena->head = block;
+        }
+    }
+
+    void *data = (unsigned char *)block->data + block->used;
+
+    block->used += size;
+    return data;
+}
+
+/* Number of bytes served by the arena */
+size_t arena_used(const arena_t *arena)
+{
+    size_t used = 0;
+
+    for (const struct arena_block *block = arena->head; block; block = block->next)
+    {
+        used += block->used;
+    }
+    return used;
+}
+
+void arena_clear(arena_t *arena)
+{
+    struct arena_block *block = arena->head;
+
+    while (block != NULL)
+    {
+        struct arena_block *next = block->next;
+
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+}
+
+void arena_destroy(arena_t *arena)
+{
+    if (arena != NULL)
+    {
+        arena_clear(arena);
+        free(arena);
+    }
+}
+
+void arena_free(void *arena)
+{
+    arena_destroy(arena);
+}
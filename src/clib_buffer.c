@@ -47,6 +47,18 @@ char *buffer_resize(buffer_t *buffer, size_t length)
     return buffer->text;
 }
 
+/* Grows the buffer to hold exactly 'length' more bytes (plus '\0') */
+char *buffer_reserve(buffer_t *buffer, size_t length)
+{
+    size_t size = buffer->length + length + 1;
+
+    if ((size > buffer->size) || (buffer->size == 0))
+    {
+        return resize(buffer, size);
+    }
+    return buffer->text;
+}
+
 char *buffer_repeat(buffer_t *buffer, char chr, size_t count)
 {
     if (buffer_resize(buffer, count) == NULL)
@@ -321,6 +321,51 @@ void *map_search_max(const map_t *map, const char *key, size_t length)
     return NULL;
 }
 
+/**
+ * Returns the copy of the first 'length' bytes of 'key' stored in the map,
+ * the key is inserted (its data is the stored copy itself) if not found
+ * Stored keys are not moved while they are in the map (string interning)
+ */
+const char *map_intern(map_t *map, const char *key, size_t length)
+{
+    if ((map == NULL) || (key == NULL))
+    {
+        return NULL;
+    }
+
+    unsigned long hash = hash_max(key, length);
+
+    map = rehash(map, hash);
+
+    struct node **head = map->list + hash % map->room;
+
+    for (struct node *node = *head; node != NULL; node = node->next)
+    {
+        if ((strncmp(node->key, key, length) == 0) && (node->key[length] == '\0'))
+        {
+            return node->key;
+        }
+    }
+
+    struct node *node = malloc(sizeof *node + length + 1);
+
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    memcpy(node->key, key, length);
+    node->key[length] = '\0';
+    node->data = node->key;
+    node->next = *head;
+    *head = node;
+    // On failure the map is still usable with longer lists
+    if (++map->size > map->room - map->room / 4)
+    {
+        map->next = map_create(map->room);
+    }
+    return node->key;
+}
+
 void *map_walk(const map_t *map, map_callback callback, void *data)
 {
     if (callback == NULL)
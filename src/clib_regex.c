@@ -4,20 +4,379 @@
  *  \copyright GNU Public License.
  */
 
-#include <stddef.h>
+/*
+--------------------------------------------------------
+Regular expressions (POSIX extended)
+--------------------------------------------------------
+- Literal patterns, optionally anchored with '^' and/or
+  '$' (i.e. "^abc", "xyz$", "^id$", "a\\.b"), are matched
+  with string functions, without regcomp/regexec
+- test_regex keeps the compiled patterns in a cache
+  keyed by pattern, bounded by regex_cache_resize
+  (least recently used patterns are dropped first),
+  invalid patterns are cached too
+- The cache is guarded by a mutex, patterns in use are
+  reference counted, so an entry dropped by a thread is
+  freed when the last thread using it releases it
+--------------------------------------------------------
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include <regex.h>
+#include "clib_hashmap.h"
 #include "clib_regex.h"
 
-int test_regex(const char *text, const char *pattern)
+#define REGEX_CACHE_SIZE 256
+
+enum { MATCH_REGEX, MATCH_CONTAINS, MATCH_PREFIX, MATCH_SUFFIX, MATCH_EXACT };
+
+struct pattern
 {
+    int type;
+    size_t length;
+    char *literal;
     regex_t regex;
-    int valid = 0;
+};
+
+/**
+ * Returns the literal of a pattern without metacharacters (other than the
+ * anchors), escaped metacharacters are literals, NULL if it is not literal
+ */
+static char *pattern_literal(const char *str, int *type)
+{
+    static const char *meta = ".[]()*+?{}|\\^$";
+    size_t length = strlen(str);
+    int prefix = 0, suffix = 0;
+
+    if (str[0] == '^')
+    {
+        prefix = 1;
+        str++;
+        length--;
+    }
+    if ((length > 0) && (str[length - 1] == '$'))
+    {
+        // An escaped '$' is a literal
+        size_t slashes = 0;
+
+        while ((slashes < length - 1) && (str[length - 2 - slashes] == '\\'))
+        {
+            slashes++;
+        }
+        if (slashes % 2 == 0)
+        {
+            suffix = 1;
+            length--;
+        }
+    }
+
+    char *literal = malloc(length + 1);
+
+    if (literal == NULL)
+    {
+        return NULL;
+    }
+
+    size_t size = 0;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        if (str[i] == '\\')
+        {
+            if ((i + 1 == length) || !strchr(meta, str[i + 1]))
+            {
+                free(literal);
+                return NULL;
+            }
+            i++;
+        }
+        else if (strchr(meta, str[i]))
+        {
+            free(literal);
+            return NULL;
+        }
+        literal[size++] = str[i];
+    }
+    literal[size] = '\0';
+    *type = prefix ? (suffix ? MATCH_EXACT : MATCH_PREFIX)
+                   : (suffix ? MATCH_SUFFIX : MATCH_CONTAINS);
+    return literal;
+}
+
+/* Compiles a pattern once for repeated calls to pattern_test() */
+pattern_t *pattern_create(const char *str)
+{
+    pattern_t *pattern = malloc(sizeof *pattern);
+
+    if (pattern == NULL)
+    {
+        return NULL;
+    }
+    pattern->type = MATCH_REGEX;
+    pattern->literal = pattern_literal(str, &pattern->type);
+    if (pattern->literal != NULL)
+    {
+        pattern->length = strlen(pattern->literal);
+        return pattern;
+    }
+    if (regcomp(&pattern->regex, str, REG_EXTENDED | REG_NOSUB))
+    {
+        free(pattern);
+        return NULL;
+    }
+    return pattern;
+}
+
+/* Same as test_regex() with a compiled pattern, NULL matches nothing */
+int pattern_test(const pattern_t *pattern, const char *text)
+{
+    if (pattern == NULL)
+    {
+        return 0;
+    }
+
+    size_t length;
+
+    switch (pattern->type)
+    {
+        case MATCH_CONTAINS:
+            return strstr(text, pattern->literal) != NULL;
+        case MATCH_PREFIX:
+            return strncmp(text, pattern->literal, pattern->length) == 0;
+        case MATCH_SUFFIX:
+            length = strlen(text);
+            return (length >= pattern->length) &&
+                !memcmp(text + length - pattern->length, pattern->literal, pattern->length);
+        case MATCH_EXACT:
+            return strcmp(text, pattern->literal) == 0;
+        default:
+            return regexec(&pattern->regex, text, 0, NULL, 0) == 0;
+    }
+}
+
+void pattern_destroy(pattern_t *pattern)
+{
+    if (pattern != NULL)
+    {
+        if (pattern->type == MATCH_REGEX)
+        {
+            regfree(&pattern->regex);
+        }
+        free(pattern->literal);
+        free(pattern);
+    }
+}
+
+struct entry
+{
+    struct entry *prev, *next;
+    pattern_t *pattern;
+    size_t refs;
+    int cached;
+    char key[];
+};
+
+static struct
+{
+    map_t *map;
+    // Most recently used first
+    struct entry *head, *tail;
+    size_t size, room, hits, misses;
+} cache = { .room = REGEX_CACHE_SIZE };
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void entry_free(struct entry *entry)
+{
+    pattern_destroy(entry->pattern);
+    free(entry);
+}
+
+static void entry_unlink(struct entry *entry)
+{
+    if (entry->prev != NULL)
+    {
+        entry->prev->next = entry->next;
+    }
+    else
+    {
+        cache.head = entry->next;
+    }
+    if (entry->next != NULL)
+    {
+        entry->next->prev = entry->prev;
+    }
+    else
+    {
+        cache.tail = entry->prev;
+    }
+    entry->prev = entry->next = NULL;
+}
+
+static void entry_link(struct entry *entry)
+{
+    entry->next = cache.head;
+    if (cache.head != NULL)
+    {
+        cache.head->prev = entry;
+    }
+    else
+    {
+        cache.tail = entry;
+    }
+    cache.head = entry;
+}
 
-    if (!regcomp(&regex, pattern, REG_EXTENDED | REG_NOSUB))
+/* Drops an entry from the cache, it is freed when no longer in use */
+static void entry_drop(struct entry *entry)
+{
+    entry_unlink(entry);
+    map_delete(cache.map, entry->key);
+    entry->cached = 0;
+    cache.size--;
+    if (entry->refs == 0)
+    {
+        entry_free(entry);
+    }
+}
+
+static void cache_trim(size_t room)
+{
+    while (cache.size > room)
+    {
+        entry_drop(cache.tail);
+    }
+}
+
+/* Returns a cached entry in use (refs incremented) */
+static struct entry *cache_get(const char *str)
+{
+    struct entry *entry = map_search(cache.map, str);
+
+    if (entry != NULL)
+    {
+        cache.hits++;
+        entry_unlink(entry);
+        entry_link(entry);
+        entry->refs++;
+        return entry;
+    }
+    cache.misses++;
+    if (cache.room == 0)
+    {
+        return NULL;
+    }
+    if ((cache.map == NULL) && !(cache.map = map_create(cache.room)))
+    {
+        return NULL;
+    }
+
+    size_t size = strlen(str) + 1;
+
+    if (!(entry = calloc(1, sizeof *entry + size)))
+    {
+        return NULL;
+    }
+    memcpy(entry->key, str, size);
+    // Invalid patterns are cached as NULL
+    entry->pattern = pattern_create(str);
+    if (map_insert(cache.map, entry->key, entry) != entry)
+    {
+        entry_free(entry);
+        return NULL;
+    }
+    entry_link(entry);
+    entry->cached = 1;
+    entry->refs = 1;
+    cache.size++;
+    cache_trim(cache.room);
+    return entry;
+}
+
+static void cache_release(struct entry *entry)
+{
+    if ((--entry->refs == 0) && !entry->cached)
     {
-        valid = regexec(&regex, text, 0, NULL, 0) == 0;
+        entry_free(entry);
+    }
+}
+
+int test_regex(const char *text, const char *str)
+{
+    pthread_mutex_lock(&mutex);
+
+    struct entry *entry = cache_get(str);
+
+    pthread_mutex_unlock(&mutex);
+
+    int valid;
+
+    if (entry != NULL)
+    {
+        valid = pattern_test(entry->pattern, text);
+        pthread_mutex_lock(&mutex);
+        cache_release(entry);
+        pthread_mutex_unlock(&mutex);
+    }
+    else
+    {
+        // Cache disabled or out of memory
+        pattern_t *pattern = pattern_create(str);
+
+        valid = pattern_test(pattern, text);
+        pattern_destroy(pattern);
     }
-    regfree(&regex);
     return valid;
 }
 
+/* Sets the maximum number of cached patterns (0 = no cache) */
+void regex_cache_resize(size_t room)
+{
+    pthread_mutex_lock(&mutex);
+    cache.room = room;
+    cache_trim(room);
+    pthread_mutex_unlock(&mutex);
+}
+
+/* Drops the cached patterns and resets the counters */
+void regex_cache_clear(void)
+{
+    pthread_mutex_lock(&mutex);
+    cache_trim(0);
+    map_destroy(cache.map, NULL);
+    cache.map = NULL;
+    cache.hits = cache.misses = 0;
+    pthread_mutex_unlock(&mutex);
+}
+
+size_t regex_cache_size(void)
+{
+    pthread_mutex_lock(&mutex);
+
+    size_t size = cache.size;
+
+    pthread_mutex_unlock(&mutex);
+    return size;
+}
+
+size_t regex_cache_hits(void)
+{
+    pthread_mutex_lock(&mutex);
+
+    size_t hits = cache.hits;
+
+    pthread_mutex_unlock(&mutex);
+    return hits;
+}
+
+size_t regex_cache_misses(void)
+{
+    pthread_mutex_lock(&mutex);
+
+    size_t misses = cache.misses;
+
+    pthread_mutex_unlock(&mutex);
+    return misses;
+}
@@ -0,0 +1,179 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+/*
+--------------------------------------------------------
+Vectorized scanners for [str, end) ranges
+--------------------------------------------------------
+scan_spaces: first byte which is not a JSON whitespace
+scan_quotes: first quote, backslash or control character
+
+- SSE2 (16 bytes per step) is used on x86-64
+- AVX2 (32 bytes per step) is selected at startup when
+  the CPU supports it
+- A scalar loop is used elsewhere and for the tails
+- Returns 'end' if there is no match
+--------------------------------------------------------
+*/
+
+#include "clib_unicode.h"
+#include "clib_scan.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SCAN_SSE2
+#include <immintrin.h>
+#endif
+
+static const char *scalar_spaces(const char *str, const char *end)
+{
+    while ((str < end) && is_space(*str))
+    {
+        str++;
+    }
+    return str;
+}
+
+static const char *scalar_quotes(const char *str, const char *end)
+{
+    while ((str < end) && (*str != '"') && (*str != '\\') && !is_cntrl(*str))
+    {
+        str++;
+    }
+    return str;
+}
+
+#ifdef SCAN_SSE2
+
+static int avx2;
+
+__attribute__((constructor))
+static void scan_load(void)
+{
+    __builtin_cpu_init();
+    avx2 = __builtin_cpu_supports("avx2");
+}
+
+/* Bits set on bytes which are not whitespaces */
+static inline unsigned sse2_spaces(__m128i data)
+{
+    __m128i mask = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(data, _mm_set1_epi8(' ')),
+                     _mm_cmpeq_epi8(data, _mm_set1_epi8('\n'))),
+        _mm_or_si128(_mm_cmpeq_epi8(data, _mm_set1_epi8('\r')),
+                     _mm_cmpeq_epi8(data, _mm_set1_epi8('\t'))));
+
+    return ~(unsigned)_mm_movemask_epi8(mask) & 0xffff;
+}
+
+/* Bits set on quotes, backslashes and control characters (unsigned <= 0x1f) */
+static inline unsigned sse2_quotes(__m128i data)
+{
+    __m128i mask = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(data, _mm_set1_epi8('"')),
+                     _mm_cmpeq_epi8(data, _mm_set1_epi8('\\'))),
+        _mm_cmpeq_epi8(_mm_min_epu8(data, _mm_set1_epi8(0x1f)), data));
+
+    return (unsigned)_mm_movemask_epi8(mask);
+}
+
+__attribute__((target("avx2")))
+static const char *avx2_spaces(const char *str, const char *end)
+{
+    while (end - str >= 32)
+    {
+        __m256i data = _mm256_loadu_si256((const __m256i *)(const void *)str);
+        __m256i mask = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(data, _mm256_set1_epi8(' ')),
+                            _mm256_cmpeq_epi8(data, _mm256_set1_epi8('\n'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(data, _mm256_set1_epi8('\r')),
+                            _mm256_cmpeq_epi8(data, _mm256_set1_epi8('\t'))));
+        unsigned bits = ~(unsigned)_mm256_movemask_epi8(mask);
+
+        if (bits != 0)
+        {
+            return str + __builtin_ctz(bits);
+        }
+        str += 32;
+    }
+    return str;
+}
+
+__attribute__((target("avx2")))
+static const char *avx2_quotes(const char *str, const char *end)
+{
+    while (end - str >= 32)
+    {
+        __m256i data = _mm256_loadu_si256((const __m256i *)(const void *)str);
+        __m256i mask = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(data, _mm256_set1_epi8('"')),
+                            _mm256_cmpeq_epi8(data, _mm256_set1_epi8('\\'))),
+            _mm256_cmpeq_epi8(_mm256_min_epu8(data, _mm256_set1_epi8(0x1f)), data));
+        unsigned bits = (unsigned)_mm256_movemask_epi8(mask);
+
+        if (bits != 0)
+        {
+            return str + __builtin_ctz(bits);
+        }
+        str += 32;
+    }
+    return str;
+}
+
+/**
+ * The AVX2 loops stop on a match or when less than 32 bytes are left, in the
+ * latter case the remaining bytes (including a possible match) are rescanned
+ */
+const char *scan_spaces(const char *str, const char *end)
+{
+    if (avx2 && (end - (str = avx2_spaces(str, end)) >= 32))
+    {
+        return str;
+    }
+    while (end - str >= 16)
+    {
+        unsigned bits = sse2_spaces(_mm_loadu_si128((const __m128i *)(const void *)str));
+
+        if (bits != 0)
+        {
+            return str + __builtin_ctz(bits);
+        }
+        str += 16;
+    }
+    return scalar_spaces(str, end);
+}
+
+const char *scan_quotes(const char *str, const char *end)
+{
+    if (avx2 && (end - (str = avx2_quotes(str, end)) >= 32))
+    {
+        return str;
+    }
+    while (end - str >= 16)
+    {
+        unsigned bits = sse2_quotes(_mm_loadu_si128((const __m128i *)(const void *)str));
+
+        if (bits != 0)
+        {
+            return str + __builtin_ctz(bits);
+        }
+        str += 16;
+    }
+    return scalar_quotes(str, end);
+}
+
+#else
+
+const char *scan_spaces(const char *str, const char *end)
+{
+    return scalar_spaces(str, end);
+}
+
+const char *scan_quotes(const char *str, const char *end)
+{
+    return scalar_quotes(str, end);
+}
+
+#endif
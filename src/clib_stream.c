@@ -4,12 +4,17 @@
  *  \copyright GNU Public License.
  */
 
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE // MAP_POPULATE
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include "clib_stream.h"
 
@@ -101,6 +106,69 @@ char *file_read_callback(const char *path, char *(*callback)(void *, size_t),
     return str;
 }
 
+static const char *map_fd(const char *path, size_t *length, int sequential)
+{
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    void *map = MAP_FAILED;
+    struct stat st;
+
+    if ((fstat(fd, &st) != -1) && S_ISREG(st.st_mode) &&
+        (st.st_size > 0) && ((uintmax_t)st.st_size <= SIZE_MAX))
+    {
+        int flags = MAP_PRIVATE;
+
+#ifdef MAP_POPULATE
+        // Prefault the pages, the whole file is going to be read
+        if (sequential)
+        {
+            flags |= MAP_POPULATE;
+        }
+#endif
+        *length = (size_t)st.st_size;
+        map = mmap(NULL, *length, PROT_READ, flags, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            posix_madvise(map, *length,
+                sequential ? POSIX_MADV_SEQUENTIAL : POSIX_MADV_RANDOM);
+        }
+    }
+    close(fd);
+    return map != MAP_FAILED ? map : NULL;
+}
+
+/**
+ * Maps a regular file read-only, the contents are not terminated by '\0'
+ * Returns NULL if the file can not be mapped (empty files, pipes, devices)
+ */
+const char *file_map(const char *path, size_t *length)
+{
+    return map_fd(path, length, 1);
+}
+
+/**
+ * Same as file_map but the pages are loaded on demand, for files that are
+ * accessed here and there (the pages are shared with other processes
+ * mapping the same file)
+ */
+const char *file_map_random(const char *path, size_t *length)
+{
+    return map_fd(path, length, 0);
+}
+
+void file_unmap(const char *str, size_t length)
+{
+    if (str != NULL)
+    {
+        munmap((void *)(uintptr_t)str, length);
+    }
+}
+
 static int write_bytes(const char *path, const char *str, size_t length, int mode)
 {
     int fd = open(path, O_WRONLY | O_CREAT | mode, 0644);
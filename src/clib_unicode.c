@@ -100,6 +100,45 @@ size_t decode_hex(const char *str, char *buf)
     }
 }
 
+/**
+ * Writes the decoded content of a valid JSON string body [str, end) into 'text'
+ * ('text' can be 'str'), returns the length of the decoded string
+ */
+size_t decode_string(char *text, const char *str, const char *end)
+{
+    char *ptr = text;
+
+    while (str < end)
+    {
+        // Copy up to the next escape sequence at once
+        const char *esc = memchr(str, '\\', (size_t)(end - str));
+        size_t length = (size_t)((esc ? esc : end) - str);
+
+        if (ptr != str)
+        {
+            memmove(ptr, str, length);
+        }
+        ptr += length;
+        str += length;
+        if (str == end)
+        {
+            break;
+        }
+        if (str[1] != 'u')
+        {
+            *ptr++ = decode_esc(str + 1);
+            str += 2;
+        }
+        else
+        {
+            ptr += decode_hex(str + 2, ptr);
+            str += 6;
+        }
+    }
+    *ptr = '\0';
+    return (size_t)(ptr - text);
+}
+
 /**
  * Converts multibyte sequence to unicode escape sequence
  * Returns the length of the multibyte in bytes
@@ -0,0 +1,590 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+/*
+--------------------------------------------------------
+Binary serialization (MessagePack)
+--------------------------------------------------------
+- Integers are written with the smallest MessagePack
+  integer format, reals always as float64, so the type
+  of the numbers is preserved in a round trip, except
+  for -0 and unsafe integers (float64, read as reals)
+- Strings are length-prefixed (no escaping), objects
+  are maps (members in order) and arrays are arrays
+- Only the subset of MessagePack produced by the
+  encoder is decoded, plus float32 (read as real),
+  map keys must be strings
+- Both directions walk the tree on explicit stacks
+--------------------------------------------------------
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "clib_math.h"
+#include "clib_check.h"
+#include "json_private.h"
+#include "json_keys.h"
+#include "json_parser.h"
+#include "json_writer.h"
+#include "json_binary.h"
+
+enum
+{
+    MP_NIL = 0xc0, MP_FALSE = 0xc2, MP_TRUE = 0xc3,
+    MP_FLOAT32 = 0xca, MP_FLOAT64 = 0xcb,
+    MP_UINT8 = 0xcc, MP_UINT16 = 0xcd, MP_UINT32 = 0xce, MP_UINT64 = 0xcf,
+    MP_INT8 = 0xd0, MP_INT16 = 0xd1, MP_INT32 = 0xd2, MP_INT64 = 0xd3,
+    MP_STR8 = 0xd9, MP_STR16 = 0xda, MP_STR32 = 0xdb,
+    MP_ARRAY16 = 0xdc, MP_ARRAY32 = 0xdd,
+    MP_MAP16 = 0xde, MP_MAP32 = 0xdf,
+    MP_FIXMAP = 0x80, MP_FIXARRAY = 0x90, MP_FIXSTR = 0xa0
+};
+
+/* Writes 'type' followed by the 'size' lower bytes of 'value' (big-endian) */
+static char *write_head(buffer_t *buffer, unsigned char type, uint64_t value, size_t size)
+{
+    char head[9] = { (char)type };
+
+    for (size_t i = 0; i < size; i++)
+    {
+        head[size - i] = (char)(value >> (i * 8));
+    }
+    return buffer_append(buffer, head, size + 1);
+}
+
+/* Writes the type of a string, an array or a map along with its length */
+static char *write_length(buffer_t *buffer, unsigned char fix, unsigned char type,
+    size_t length)
+{
+    if (length < (fix == MP_FIXSTR ? 32u : 16u))
+    {
+        return write_head(buffer, (unsigned char)(fix | length), 0, 0);
+    }
+    if ((fix == MP_FIXSTR) && (length <= UINT8_MAX))
+    {
+        return write_head(buffer, MP_STR8, length, 1);
+    }
+    if (length <= UINT16_MAX)
+    {
+        return write_head(buffer, type, length, 2);
+    }
+    if (length <= UINT32_MAX)
+    {
+        return write_head(buffer, (unsigned char)(type + 1), length, 4);
+    }
+    return NULL;
+}
+
+static char *write_string(buffer_t *buffer, const char *str)
+{
+    size_t length = strlen(str);
+
+    CHECK(write_length(buffer, MP_FIXSTR, MP_STR16, length));
+    return buffer_append(buffer, str, length);
+}
+
+static char *write_integer(buffer_t *buffer, double number)
+{
+    if (number >= 0)
+    {
+        uint64_t value = (uint64_t)number;
+
+        if (value <= 0x7f)
+        {
+            return write_head(buffer, (unsigned char)value, 0, 0);
+        }
+        if (value <= UINT8_MAX)
+        {
+            return write_head(buffer, MP_UINT8, value, 1);
+        }
+        if (value <= UINT16_MAX)
+        {
+            return write_head(buffer, MP_UINT16, value, 2);
+        }
+        if (value <= UINT32_MAX)
+        {
+            return write_head(buffer, MP_UINT32, value, 4);
+        }
+        return write_head(buffer, MP_UINT64, value, 8);
+    }
+
+    int64_t value = (int64_t)number;
+
+    if (value >= -32)
+    {
+        return write_head(buffer, (unsigned char)value, 0, 0);
+    }
+    if (value >= INT8_MIN)
+    {
+        return write_head(buffer, MP_INT8, (uint64_t)value, 1);
+    }
+    if (value >= INT16_MIN)
+    {
+        return write_head(buffer, MP_INT16, (uint64_t)value, 2);
+    }
+    if (value >= INT32_MIN)
+    {
+        return write_head(buffer, MP_INT32, (uint64_t)value, 4);
+    }
+    return write_head(buffer, MP_INT64, (uint64_t)value, 8);
+}
+
+static char *write_real(buffer_t *buffer, double number)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &number, sizeof bits);
+    return write_head(buffer, MP_FLOAT64, bits, 8);
+}
+
+/* Writes a node, iterables are written as a head with the number of children */
+static char *write_node(buffer_t *buffer, const json_t *node)
+{
+    switch (node->type)
+    {
+        case JSON_OBJECT:
+            return write_length(buffer, MP_FIXMAP, MP_MAP16, node->size);
+        case JSON_ARRAY:
+            return write_length(buffer, MP_FIXARRAY, MP_ARRAY16, node->size);
+        case JSON_STRING:
+            return write_string(buffer, node->string);
+        case JSON_INTEGER:
+            // Types are not enforced, the user can store any value in a node
+            // -0 has no integer format, the sign is kept as a float64
+            if (IS_SAFE_INTEGER(node->number) && (node->number == trunc(node->number)) &&
+                !((node->number == 0) && signbit(node->number)))
+            {
+                return write_integer(buffer, node->number);
+            }
+            return write_real(buffer, node->number);
+        case JSON_REAL:
+            return write_real(buffer, node->number);
+        case JSON_TRUE:
+            return write_head(buffer, MP_TRUE, 0, 0);
+        case JSON_FALSE:
+            return write_head(buffer, MP_FALSE, 0, 0);
+        default:
+            return write_head(buffer, MP_NIL, 0, 0);
+    }
+}
+
+static int encode_tree(buffer_t *buffer, const json_t *node)
+{
+    struct json_stack stack = { 0 };
+    int rc = json_stack_push(&stack, node, NULL);
+
+    while (rc && (stack.size > 0))
+    {
+        struct json_frame *frame = json_stack_top(&stack);
+
+        if (frame->index == frame->node->size)
+        {
+            stack.size--;
+            continue;
+        }
+
+        const json_t *child = frame->node->child[frame->index++];
+
+        rc = ((frame->node->type != JSON_OBJECT) || write_string(buffer, child->key))
+          && write_node(buffer, child)
+          && ((child->size == 0) || json_stack_push(&stack, child, NULL));
+    }
+    json_stack_free(&stack);
+    return rc;
+}
+
+/**
+ * Appends the MessagePack encoding of a JSON structure or a single node to
+ * 'buffer' (buffer->length bytes, the text can contain '\0's)
+ * If the passed node IS a property, it is written as {key: value}
+ */
+char *json_encode_binary(buffer_t *buffer, const json_t *node)
+{
+    if ((buffer == NULL) || (node == NULL))
+    {
+        return NULL;
+    }
+
+    const json_t parent =
+    {
+        .child = (json_t *[]){json_cast(node)},
+        .size = 1,
+        .type = node->key ? JSON_OBJECT : JSON_ARRAY
+    };
+    const json_t grandparent =
+    {
+         .child = (json_t *[]){json_cast(&parent)},
+         .size = 1,
+         .type = JSON_ARRAY
+    };
+
+    if (!encode_tree(buffer, node->key ? &grandparent : &parent))
+    {
+        return NULL;
+    }
+    return buffer->text;
+}
+
+typedef struct
+{
+    const unsigned char *str, *end;
+    // Iterables being decoded and the number of children they expect
+    struct { json_t *node; size_t size; } *open;
+    size_t depth, room;
+    struct map *keys;
+} decoder_t;
+
+/* Reads a big-endian integer of 'size' bytes */
+static int read_uint(decoder_t *decoder, size_t size, uint64_t *value)
+{
+    if ((size_t)(decoder->end - decoder->str) < size)
+    {
+        return 0;
+    }
+    *value = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        *value = (*value << 8) | *decoder->str++;
+    }
+    return 1;
+}
+
+/* Reads the length of a string, returns 0 if the next item is not a string */
+static int read_string(decoder_t *decoder, const char **str, size_t *length)
+{
+    if (decoder->str == decoder->end)
+    {
+        return 0;
+    }
+
+    unsigned char type = *decoder->str++;
+    uint64_t value;
+
+    if ((type & 0xe0) == MP_FIXSTR)
+    {
+        value = type & 0x1f;
+    }
+    else if ((type < MP_STR8) || (type > MP_STR32) ||
+             !read_uint(decoder, (size_t)1 << (type - MP_STR8), &value))
+    {
+        return 0;
+    }
+    if (value > (uint64_t)(decoder->end - decoder->str))
+    {
+        return 0;
+    }
+    *str = (const char *)decoder->str;
+    *length = (size_t)value;
+    decoder->str += value;
+    return 1;
+}
+
+/**
+ * Returns a new node, the key and the string are copied right after the node
+ * (as the parser does), keys are interned when a table is set (see json_keys.c)
+ */
+static json_t *new_node(const decoder_t *decoder, unsigned char type,
+    const char *key, size_t key_length, const char *str, size_t length)
+{
+    char *shared = NULL;
+
+    if ((key != NULL) && (decoder->keys != NULL) && !memchr(key, '\0', key_length))
+    {
+        if ((shared = json_keys_intern(decoder->keys, key, key_length)) == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    size_t size = sizeof(json_t);
+
+    size += key && !shared ? sizeof(struct json_keyref) + key_length + 1 : 0;
+    size += str ? length + 1 : 0;
+
+    json_t *node = malloc(size);
+
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    *node = (json_t){ .type = type };
+
+    char *text = (char *)(node + 1);
+
+    if (shared != NULL)
+    {
+        node->key = shared;
+        node->packed |= JSON_BORROWED_KEY;
+    }
+    else if (key != NULL)
+    {
+        struct json_keyref *ref = (struct json_keyref *)(void *)text;
+
+        ref->parent = NULL;
+        node->key = memcpy(ref->key, key, key_length);
+        node->key[key_length] = '\0';
+        node->packed |= JSON_BORROWED_KEY | JSON_KEYED;
+        text = ref->key + key_length + 1;
+    }
+    if (str != NULL)
+    {
+        node->string = memcpy(text, str, length);
+        node->string[length] = '\0';
+        node->packed |= JSON_BORROWED_STRING;
+    }
+    return node;
+}
+
+static json_t *new_number(const decoder_t *decoder, const char *key, size_t key_length,
+    double number, int integer)
+{
+    unsigned char type = integer && IS_SAFE_INTEGER(number) ? JSON_INTEGER : JSON_REAL;
+    json_t *node = new_node(decoder, type, key, key_length, NULL, 0);
+
+    if (node != NULL)
+    {
+        node->number = number;
+    }
+    return node;
+}
+
+/* Decodes the next item, iterables are returned empty with their size in 'size' */
+static json_t *read_node(decoder_t *decoder, const char *key, size_t key_length,
+    size_t *size)
+{
+    if (decoder->str == decoder->end)
+    {
+        return NULL;
+    }
+
+    unsigned char type = *decoder->str;
+    uint64_t value;
+
+    *size = 0;
+    if (((type & 0xe0) == MP_FIXSTR) || ((type >= MP_STR8) && (type <= MP_STR32)))
+    {
+        const char *str;
+        size_t length;
+
+        if (!read_string(decoder, &str, &length) || memchr(str, '\0', length))
+        {
+            return NULL;
+        }
+        return new_node(decoder, JSON_STRING, key, key_length, str, length);
+    }
+    decoder->str++;
+    if (type <= 0x7f)
+    {
+        return new_number(decoder, key, key_length, type, 1);
+    }
+    if (type >= 0xe0)
+    {
+        return new_number(decoder, key, key_length, (int8_t)type, 1);
+    }
+    if (((type & 0xf0) == MP_FIXMAP) || ((type & 0xf0) == MP_FIXARRAY))
+    {
+        *size = type & 0x0f;
+        return new_node(decoder, (type & 0xf0) == MP_FIXMAP ? JSON_OBJECT : JSON_ARRAY,
+            key, key_length, NULL, 0);
+    }
+    switch (type)
+    {
+        case MP_NIL:
+            return new_node(decoder, JSON_NULL, key, key_length, NULL, 0);
+        case MP_FALSE:
+            return new_node(decoder, JSON_FALSE, key, key_length, NULL, 0);
+        case MP_TRUE:
+            return new_node(decoder, JSON_TRUE, key, key_length, NULL, 0);
+        case MP_FLOAT32:
+        {
+            float number;
+
+            CHECK(read_uint(decoder, 4, &value));
+
+            uint32_t bits = (uint32_t)value;
+
+            memcpy(&number, &bits, sizeof number);
+            return new_number(decoder, key, key_length, number, 0);
+        }
+        case MP_FLOAT64:
+        {
+            double number;
+
+            CHECK(read_uint(decoder, 8, &value));
+            memcpy(&number, &value, sizeof number);
+            return new_number(decoder, key, key_length, number, 0);
+        }
+        case MP_UINT8:
+        case MP_UINT16:
+        case MP_UINT32:
+        case MP_UINT64:
+            CHECK(read_uint(decoder, (size_t)1 << (type - MP_UINT8), &value));
+            return new_number(decoder, key, key_length, (double)value, 1);
+        case MP_INT8:
+        case MP_INT16:
+        case MP_INT32:
+        case MP_INT64:
+        {
+            size_t bytes = (size_t)1 << (type - MP_INT8);
+
+            CHECK(read_uint(decoder, bytes, &value));
+            // Sign extension
+            if ((bytes < 8) && (value >> (bytes * 8 - 1)))
+            {
+                value |= ~(uint64_t)0 << (bytes * 8);
+            }
+            return new_number(decoder, key, key_length, (double)(int64_t)value, 1);
+        }
+        case MP_ARRAY16:
+        case MP_ARRAY32:
+        case MP_MAP16:
+        case MP_MAP32:
+        {
+            int map = (type == MP_MAP16) || (type == MP_MAP32);
+            size_t bytes = (type == MP_ARRAY16) || (type == MP_MAP16) ? 2 : 4;
+
+            CHECK(read_uint(decoder, bytes, &value));
+            // Each child takes one byte at least
+            if (value > (uint64_t)(decoder->end - decoder->str))
+            {
+                return NULL;
+            }
+            *size = (size_t)value;
+            return new_node(decoder, map ? JSON_OBJECT : JSON_ARRAY, key, key_length, NULL, 0);
+        }
+        default:
+            return NULL;
+    }
+}
+
+/* Pushes an iterable expecting 'size' children */
+static int open_node(decoder_t *decoder, json_t *node, size_t size)
+{
+    if (decoder->depth == decoder->room)
+    {
+        size_t room = decoder->room ? decoder->room * 2 : 32;
+        void *open = realloc(decoder->open, sizeof(*decoder->open) * room);
+
+        if (open == NULL)
+        {
+            return 0;
+        }
+        decoder->open = open;
+        decoder->room = room;
+    }
+    // Room for the next power of 2 (the layout expected by the writer)
+    if (!(node->child = malloc(sizeof(*node->child) * next_pow2(size))))
+    {
+        return 0;
+    }
+    decoder->open[decoder->depth].node = node;
+    decoder->open[decoder->depth].size = size;
+    decoder->depth++;
+    return 1;
+}
+
+/* Large objects are indexed once all the members are in place */
+static void close_node(json_t *node)
+{
+    if ((node->type == JSON_OBJECT) && (node->size >= JSON_KEYMAP_MIN))
+    {
+        // On failure the object is still usable without an index
+        json_keymap_attach(node, next_pow2(node->size));
+    }
+}
+
+static json_t *decode(decoder_t *decoder)
+{
+    json_t *root = NULL;
+
+    do
+    {
+        json_t *parent = decoder->depth ? decoder->open[decoder->depth - 1].node : NULL;
+        const char *key = NULL;
+        size_t key_length = 0;
+        size_t size;
+
+        if ((parent != NULL) && (parent->type == JSON_OBJECT) &&
+            !read_string(decoder, &key, &key_length))
+        {
+            goto error;
+        }
+
+        json_t *node = read_node(decoder, key, key_length, &size);
+
+        if (node == NULL)
+        {
+            goto error;
+        }
+        if (parent != NULL)
+        {
+            node->packed |= JSON_PACKED;
+            parent->child[parent->size++] = node;
+        }
+        else
+        {
+            root = node;
+        }
+        if (size > 0)
+        {
+            if ((decoder->depth >= json_parser_get_max_depth()) ||
+                !open_node(decoder, node, size))
+            {
+                goto error;
+            }
+            continue;
+        }
+        // Closes the iterables completed by this node
+        while ((decoder->depth > 0) &&
+               (decoder->open[decoder->depth - 1].node->size ==
+                decoder->open[decoder->depth - 1].size))
+        {
+            close_node(decoder->open[--decoder->depth].node);
+        }
+    } while (decoder->depth > 0);
+    return root;
+error:
+    // Empty iterables own an array of children
+    for (size_t i = 0; i < decoder->depth; i++)
+    {
+        json_t *node = decoder->open[i].node;
+
+        if (node->size == 0)
+        {
+            free(node->child);
+            node->child = NULL;
+        }
+    }
+    json_delete(root);
+    return NULL;
+}
+
+/* Decodes 'length' bytes of MessagePack, returns NULL on invalid input */
+json_t *json_decode_binary(const char *data, size_t length)
+{
+    if (data == NULL)
+    {
+        return NULL;
+    }
+
+    decoder_t decoder =
+    {
+        .str = (const unsigned char *)data,
+        .end = (const unsigned char *)data + length,
+        .keys = json_get_keys()
+    };
+    json_t *node = decode(&decoder);
+
+    free(decoder.open);
+    if ((node != NULL) && (decoder.str != decoder.end))
+    {
+        json_delete(node);
+        return NULL;
+    }
+    return node;
+}
@@ -7,8 +7,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
 #include "clib_math.h"
+#include "clib_number.h"
 #include "clib_check.h"
+#include "clib_scan.h"
 #include "clib_unicode.h"
 #include "json_private.h"
 #include "json_buffer.h"
@@ -32,83 +37,90 @@ void json_set_encoding(enum json_encoding mode)
 }
 
 /**
- * According to IEEE 754-1985, double can represent numbers with maximum
- * accuracy of 17 digits after point. Add to it both minuses for mantissa
- * and period, point, e-char and 3 digits of period (8 bit), and you will
- * get exact 24 chars.
+ * Numbers are written straight into the buffer without printf, when there is
+ * not enough room (i.e. an exact size was reserved) they go through the stack
  */
-#define MAX_DECIMALS 17
-#define NUMBER_CHARS 24
+static char *write_real(buffer_t *buffer, double number)
+{
+    if (buffer->size - buffer->length < NUMBER_FORMAT_SIZE)
+    {
+        char text[NUMBER_FORMAT_SIZE];
 
-#define write_number(buffer, ...) (size_t) \
-    snprintf(buffer->text + buffer->length, NUMBER_CHARS + 1, __VA_ARGS__)
+        return buffer_append(buffer, text, number_format(text, number));
+    }
+    buffer->length += number_format(buffer->text + buffer->length, number);
+    return buffer->text;
+}
 
 static char *write_integer(buffer_t *buffer, double number)
 {
-    if (buffer->size - buffer->length <= NUMBER_CHARS)
+    // Types are not enforced, the user can store any value in a node
+    if (!IS_SAFE_INTEGER(number) || (number != trunc(number)))
     {
-        CHECK(buffer_resize(buffer, NUMBER_CHARS));
+        return write_real(buffer, number);
     }
-
-    size_t length = write_number(buffer, "%.0f", number);
-
-    if (length > NUMBER_CHARS)
+    if (buffer->size - buffer->length < NUMBER_FORMAT_SIZE)
     {
-        buffer_set_error(buffer, BUFFER_ERROR_FORMAT);
-        return NULL;
+        char text[NUMBER_FORMAT_SIZE];
+
+        return buffer_append(buffer, text, integer_format(text, number));
     }
-    buffer->length += length;
+    buffer->length += integer_format(buffer->text + buffer->length, number);
     return buffer->text;
 }
 
-static char *write_real(buffer_t *buffer, double number)
+/* Writes an escape sequence for the character at 'str', returns its length */
+static size_t write_escape(buffer_t *buffer, const char *str)
 {
-    if (buffer->size - buffer->length <= NUMBER_CHARS)
-    {
-        CHECK(buffer_resize(buffer, NUMBER_CHARS));
-    }
-
-    size_t length = write_number(buffer, "%.*g", MAX_DECIMALS, number);
+    char esc = encode_esc(str);
 
-    if (length > NUMBER_CHARS)
+    if (esc != '\0')
     {
-        buffer_set_error(buffer, BUFFER_ERROR_FORMAT);
-        return NULL;
+        const char seq[] = { '\\', esc, '\0' };
+
+        return buffer_append(buffer, seq, 2) ? 1 : 0;
     }
 
-    /* Dot followed by trailing zeros are removed when %g is used */
-    int done = strspn(buffer->text + buffer->length, "-0123456789") != length;
+    char seq[sizeof("\\u0123")] = { '\0' };
+    size_t length = encode_hex(str, seq);
 
-    buffer->length += length;
-    /* Write the fractional part if applicable */
-    return done ? buffer->text : buffer_write(buffer, ".0");
+    return buffer_append(buffer, seq, 6) ? length : 0;
 }
 
 static char *write_string(buffer_t *buffer, const char *str)
 {
     CHECK(buffer_put(buffer, '"'));
+    if (encoding == JSON_UTF8)
+    {
+        // Only quotes, backslashes and control characters are escaped
+        const char *end = str + strlen(str);
+        const char *ptr;
+
+        while ((ptr = scan_quotes(str, end)) < end)
+        {
+            CHECK(buffer_append(buffer, str, (size_t)(ptr - str)));
+
+            size_t length = write_escape(buffer, ptr);
+
+            CHECK(length);
+            str = ptr + length;
+        }
+        CHECK(buffer_append(buffer, str, (size_t)(end - str)));
+        return buffer_put(buffer, '"');
+    }
 
     const char *ptr = str;
 
+    // Non ASCII characters are escaped as well
     while (*str != '\0')
     {
-        char esc = encode_esc(str);
-
-        if (esc != '\0')
+        if ((encode_esc(str) != '\0') || is_cntrl(*str) || !is_ascii(*str))
         {
-            const char seq[] = { '\\', esc, '\0' };
-
             CHECK(buffer_append(buffer, ptr, (size_t)(str - ptr)));
-            CHECK(buffer_append(buffer, seq, 2));
-            ptr = ++str;
-        }
-        else if (is_cntrl(*str) || ((encoding == JSON_ASCII) && !is_ascii(*str)))
-        {
-            char seq[sizeof("\\u0123")] = { '\0' };
-            size_t length = encode_hex(str, seq);
 
-            CHECK(buffer_append(buffer, ptr, (size_t)(str - ptr)));
-            CHECK(buffer_append(buffer, seq, 6));
+            size_t length = write_escape(buffer, str);
+
+            CHECK(length);
             str += length;
             ptr = str;
         }
@@ -216,36 +228,217 @@ static int encode_edge(buffer_t *buffer, const json_t *node,
     return buffer->text != NULL;
 }
 
-#define MAX_INDENT 8
+/* Exact length of the text written by write_string */
+static size_t string_size(const char *str)
+{
+    if (encoding == JSON_UTF8)
+    {
+        size_t length = strlen(str);
+        const char *end = str + length;
+        size_t size = length + 2;
 
-static int encode_tree(buffer_t *buffer, const json_t *node,
-    unsigned short depth, unsigned char indent)
+        while ((str = scan_quotes(str, end)) < end)
+        {
+            size += encode_esc(str) != '\0' ? 1 : 5;
+            str++;
+        }
+        return size;
+    }
+
+    size_t size = 2;
+
+    while (*str != '\0')
+    {
+        if (encode_esc(str) != '\0')
+        {
+            size += 2;
+            str++;
+        }
+        else if (is_cntrl(*str) || !is_ascii(*str))
+        {
+            char seq[sizeof("\\u0123")];
+
+            size += 6;
+            str += encode_hex(str, seq);
+        }
+        else
+        {
+            size++;
+            str++;
+        }
+    }
+    return size;
+}
+
+/* Exact length of the text written by write_integer and write_real */
+static size_t number_size(double number, unsigned char type)
 {
-    for (unsigned i = 0; i < node->size; i++)
+    char text[NUMBER_FORMAT_SIZE];
+
+    if ((type == JSON_INTEGER) && IS_SAFE_INTEGER(number) && (number == trunc(number)))
     {
-        unsigned char more = node->size > i + 1;
+        return integer_format(text, number);
+    }
+    return number_format(text, number);
+}
 
-        CHECK(encode_node(buffer, node->child[i], depth, indent, more));
-        if (node->child[i]->size > 0)
+/* Exact length of the text written by encode_node (and encode_edge) */
+static size_t node_size(const json_t *node,
+    unsigned short depth, unsigned char indent,
+    unsigned char trailing_comma)
+{
+    size_t size = (size_t)(depth * indent) + (indent > 0);
+
+    if (node->key != NULL)
+    {
+        size += string_size(node->key) + (indent == 0 ? 1 : 2);
+    }
+    switch (node->type)
+    {
+        case JSON_OBJECT:
+        case JSON_ARRAY:
+            size += 1;
+            break;
+        case JSON_STRING:
+            size += string_size(node->string);
+            break;
+        case JSON_INTEGER:
+        case JSON_REAL:
+            size += number_size(node->number, node->type);
+            break;
+        case JSON_TRUE:
+        case JSON_NULL:
+            size += 4;
+            break;
+        case JSON_FALSE:
+            size += 5;
+            break;
+    }
+    if (node->size == 0)
+    {
+        size += (node->type == JSON_OBJECT) || (node->type == JSON_ARRAY);
+        size += trailing_comma;
+    }
+    else
+    {
+        // encode_edge
+        size += (size_t)(depth * indent) + 1 + trailing_comma + (indent > 0);
+    }
+    return size;
+}
+
+/* Walks the tree as encode_tree does, returns 0 on allocation failure */
+static int tree_size(const json_t *node, unsigned char indent, size_t *size)
+{
+    struct json_stack stack = { 0 };
+    int rc = json_stack_push(&stack, node, NULL);
+
+    while (rc && (stack.size > 0))
+    {
+        struct json_frame *frame = json_stack_top(&stack);
+        unsigned short depth = (unsigned short)(stack.size - 1);
+
+        if (frame->index == frame->node->size)
+        {
+            stack.size--;
+            continue;
+        }
+
+        const json_t *child = frame->node->child[frame->index++];
+        unsigned char more = frame->node->size > frame->index;
+
+        // Includes the edge of iterables
+        *size += node_size(child, depth, indent, more);
+        if (child->size > 0)
         {
-            CHECK(encode_tree(buffer, node->child[i], depth + 1, indent));
-            CHECK(encode_edge(buffer, node->child[i], depth, indent, more));
+            rc = json_stack_push(&stack, child, NULL);
         }
     }
+    json_stack_free(&stack);
+    return rc;
+}
+
+#define MAX_INDENT 8
+
+typedef struct
+{
+    buffer_t *buffer;
+    // When not NULL the text is passed to 'write' every 'chunk' bytes (streaming)
+    json_write_callback write;
+    void *data;
+    size_t chunk;
+    // When 'buffer' is NULL the output is only measured
+    size_t size;
+} encoder_t;
+
+/* Hands the encoded text to the callback once a chunk is filled */
+static int drain(encoder_t *encoder)
+{
+    buffer_t *buffer = encoder->buffer;
+
+    if ((encoder->write != NULL) && (buffer->length >= encoder->chunk))
+    {
+        CHECK(encoder->write(buffer->text, buffer->length, encoder->data));
+        buffer_set_length(buffer, 0);
+    }
     return 1;
 }
 
+/**
+ * The tree is traversed on an explicit stack, the closing edge of an iterable
+ * is written when its frame is popped (the node being the previous child of
+ * the frame below)
+ */
+static int encode_tree(encoder_t *encoder, const json_t *node, unsigned char indent)
+{
+    buffer_t *buffer = encoder->buffer;
+    struct json_stack stack = { 0 };
+    int rc = json_stack_push(&stack, node, NULL);
+
+    while (rc && (stack.size > 0))
+    {
+        struct json_frame *frame = json_stack_top(&stack);
+
+        if (frame->index == frame->node->size)
+        {
+            if (--stack.size > 0)
+            {
+                frame = json_stack_top(&stack);
+
+                unsigned short depth = (unsigned short)(stack.size - 1);
+                unsigned char more = frame->node->size > frame->index;
+
+                rc = encode_edge(buffer, frame->node->child[frame->index - 1], depth, indent, more)
+                  && drain(encoder);
+            }
+            continue;
+        }
+
+        const json_t *child = frame->node->child[frame->index++];
+        unsigned short depth = (unsigned short)(stack.size - 1);
+        unsigned char more = frame->node->size > frame->index;
+
+        if (!(rc = encode_node(buffer, child, depth, indent, more)))
+        {
+            break;
+        }
+        rc = child->size > 0 ? json_stack_push(&stack, child, NULL) : drain(encoder);
+    }
+    json_stack_free(&stack);
+    return rc;
+}
+
 /**
  * Encodes a node into a provided buffer.
  * The cast from 'const json_t *' to 'json_t *' is needed to pack the children.
  * If the passed node IS a property, add parent and grandparent: [{key: value}]
  * If the passed node IS NOT a property, add parent: [value]
  */
-static char *buffer_encode(buffer_t *buffer, const json_t *node, size_t indent)
+static int encoder_run(encoder_t *encoder, const json_t *node, size_t indent)
 {
     if (node == NULL)
     {
-        return NULL;
+        return 0;
     }
 
     const json_t parent =
@@ -265,22 +458,114 @@ static char *buffer_encode(buffer_t *buffer, const json_t *node, size_t indent)
     {
         indent = MAX_INDENT;
     }
-    if (node->key != NULL)
+    if (encoder->buffer == NULL)
     {
-        CHECK(encode_tree(buffer, &grandparent, 0, (unsigned char)indent));
+        // Measuring (see json_encoded_size)
+        encoder->size = 0;
+        return tree_size(node->key ? &grandparent : &parent, (unsigned char)indent, &encoder->size);
     }
-    else
+    return encode_tree(encoder, node->key ? &grandparent : &parent, (unsigned char)indent);
+}
+
+/**
+ * Returns the exact length of the text produced by json_encode (without the
+ * trailing '\0'), 0 if 'node' is NULL
+ * Callers reusing a buffer can pass it to buffer_reserve before encoding
+ */
+size_t json_encoded_size(const json_t *node, size_t indent)
+{
+    encoder_t encoder = { 0 };
+
+    return encoder_run(&encoder, node, indent) ? encoder.size : 0;
+}
+
+static char *buffer_encode(buffer_t *buffer, const json_t *node, size_t indent)
+{
+    encoder_t encoder = { .buffer = buffer };
+
+    return encoder_run(&encoder, node, indent) ? buffer->text : NULL;
+}
+
+#define STREAM_CHUNK (64 * 1024)
+
+/**
+ * Serializes through a fixed size chunk, the text is passed to 'callback' as
+ * the tree is walked (the whole document is never held in memory)
+ * The output is the same produced by json_encode, returns 0 on failure
+ * (the callback returns 0 to signal a write error)
+ */
+int json_write_stream(const json_t *node, size_t indent,
+    json_write_callback callback, void *data)
+{
+    if (callback == NULL)
     {
-        CHECK(encode_tree(buffer, &parent, 0, (unsigned char)indent));
+        return 0;
     }
-    return buffer->text;
+
+    buffer_t buffer = { 0 };
+    encoder_t encoder =
+    {
+        .buffer = &buffer,
+        .write = callback,
+        .data = data,
+        .chunk = STREAM_CHUNK
+    };
+    int rc = buffer_resize(&buffer, STREAM_CHUNK) &&
+             encoder_run(&encoder, node, indent) &&
+             ((buffer.length == 0) || callback(buffer.text, buffer.length, data));
+
+    free(buffer.text);
+    return rc;
+}
+
+static int write_stream(const char *text, size_t length, void *file)
+{
+    return fwrite(text, 1, length, file) == length;
+}
+
+static int write_fd(const char *text, size_t length, void *data)
+{
+    int fd = *(int *)data;
+    size_t count = 0;
+
+    while (count < length)
+    {
+        ssize_t bytes = write(fd, text + count, length - count);
+
+        if (bytes == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return 0;
+        }
+        count += (size_t)bytes;
+    }
+    return 1;
+}
+
+/* Serializes into a file descriptor through a fixed size chunk */
+int json_write_fd(const json_t *node, int fd, size_t indent)
+{
+    return (fd >= 0) && json_write_stream(node, indent, write_fd, &fd);
 }
 
 /* Serializes a JSON structure or a single node into a compact string */
 char *json_encode(const json_t *node, size_t indent)
 {
+    if (node == NULL)
+    {
+        return NULL;
+    }
+
     buffer_t buffer = { 0 };
 
+    // Measured first and allocated at once, no reallocs while encoding
+    if (!buffer_reserve(&buffer, json_encoded_size(node, indent)))
+    {
+        return NULL;
+    }
     return buffer_encode(&buffer, node, indent);
 }
 
@@ -297,16 +582,20 @@ char *json_buffer_encode(buffer_t *buffer, const json_t *node, size_t indent)
 /* Serializes without indentation */
 char *json_stringify(const json_t *node)
 {
-    buffer_t buffer = { 0 };
-
-    return buffer_encode(&buffer, node, 0);
+    return json_encode(node, 0);
 }
 
 #define write_file(buffer, file) \
     (fwrite(buffer.text, 1, buffer.length, file) == buffer.length)
 
-/* Serializes into a file */
+/* Serializes into a file through a fixed size chunk */
 int json_write(const json_t *node, FILE *file, size_t indent)
+{
+    return (file != NULL) && json_write_stream(node, indent, write_stream, file);
+}
+
+/* Serializes into a file with a trailing newline */
+int json_write_line(const json_t *node, FILE *file)
 {
     int rc = 0;
 
@@ -314,7 +603,7 @@ int json_write(const json_t *node, FILE *file, size_t indent)
     {
         buffer_t buffer = { 0 };
 
-        if (buffer_encode(&buffer, node, indent))
+        if (buffer_encode(&buffer, node, 0) && buffer_put(&buffer, '\n'))
         {
             rc = write_file(buffer, file);
         }
@@ -323,21 +612,98 @@ int json_write(const json_t *node, FILE *file, size_t indent)
     return rc;
 }
 
-/* Serializes into a file with a trailing newline */
-int json_write_line(const json_t *node, FILE *file)
+/**
+ * JSON Lines sink: records are encoded compactly one after another into a
+ * single buffer which is written to 'fd' in large batches when 'flush_size'
+ * bytes or 'flush_records' records are reached (0 = default / no limit)
+ * A failed write or allocation is sticky, json_sink_close reports it
+ */
+struct json_sink
 {
-    int rc = 0;
+    buffer_t buffer;
+    size_t flush_size, flush_records;
+    size_t records;
+    int fd;
+    int error;
+};
 
-    if (file != NULL)
+#define SINK_FLUSH_SIZE (1024 * 1024)
+
+json_sink_t *json_sink_create(int fd, size_t flush_size, size_t flush_records)
+{
+    if (fd < 0)
     {
-        buffer_t buffer = { 0 };
+        return NULL;
+    }
 
-        if (buffer_encode(&buffer, node, 0) && buffer_put(&buffer, '\n'))
+    json_sink_t *sink = calloc(1, sizeof *sink);
+
+    if (sink != NULL)
+    {
+        sink->fd = fd;
+        sink->flush_size = flush_size ? flush_size : SINK_FLUSH_SIZE;
+        sink->flush_records = flush_records;
+        // Room for a whole batch plus the record crossing the threshold
+        if (!buffer_resize(&sink->buffer, sink->flush_size))
         {
-            rc = write_file(buffer, file);
+            free(sink);
+            return NULL;
         }
-        free(buffer.text);
     }
+    return sink;
+}
+
+/* Writes the pending records, returns 0 on failure */
+int json_sink_flush(json_sink_t *sink)
+{
+    if ((sink == NULL) || sink->error)
+    {
+        return 0;
+    }
+    if (!write_fd(sink->buffer.text, sink->buffer.length, &sink->fd))
+    {
+        sink->error = 1;
+        return 0;
+    }
+    // Keep the capacity for the next batch
+    buffer_set_length(&sink->buffer, 0);
+    sink->records = 0;
+    return 1;
+}
+
+/* Appends 'node' and a newline, flushes when a threshold is reached */
+int json_sink_write(json_sink_t *sink, const json_t *node)
+{
+    if ((sink == NULL) || (node == NULL) || sink->error)
+    {
+        return 0;
+    }
+    if (!buffer_encode(&sink->buffer, node, 0) || !buffer_put(&sink->buffer, '\n'))
+    {
+        sink->error = 1;
+        return 0;
+    }
+    sink->records++;
+    if ((sink->buffer.length >= sink->flush_size) ||
+        (sink->flush_records && (sink->records >= sink->flush_records)))
+    {
+        return json_sink_flush(sink);
+    }
+    return 1;
+}
+
+/* Flushes and releases the sink (the descriptor is not closed) */
+int json_sink_close(json_sink_t *sink)
+{
+    if (sink == NULL)
+    {
+        return 0;
+    }
+
+    int rc = json_sink_flush(sink);
+
+    free(sink->buffer.text);
+    free(sink);
     return rc;
 }
 
@@ -349,14 +715,11 @@ int json_write_file(const json_t *node, const char *path, size_t indent)
 
     if ((node != NULL) && (path != NULL) && (file = fopen(path, "w")))
     {
-        buffer_t buffer = { 0 };
-
-        if (buffer_encode(&buffer, node, indent))
+        rc = json_write_stream(node, indent, write_stream, file);
+        if (fclose(file) != 0)
         {
-            rc = write_file(buffer, file);
+            rc = 0;
         }
-        free(buffer.text);
-        fclose(file);
     }
     return rc;
 }
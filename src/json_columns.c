@@ -0,0 +1,535 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+/*
+--------------------------------------------------------
+Columnar arrays of objects
+--------------------------------------------------------
+- An array of objects sharing a shape ([{"a":..,"b":..},
+  ...]) is stored as one contiguous column per field
+- Numbers are stored as double[], strings as ids of a
+  symbol table and booleans as a bitset
+- Null and missing fields are flagged in bitsets, their
+  cells hold 0 (sums can be computed without checking)
+- The shape is taken from the first object unless the
+  names of the fields are given, in that case other
+  members are not stored
+- Nested values and columns mixing types are rejected,
+  such arrays must be kept as a tree
+--------------------------------------------------------
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "clib_string.h"
+#include "clib_hashmap.h"
+#include "json_private.h"
+#include "json_writer.h"
+#include "json_columns.h"
+
+#define BITS 64
+#define words(rows) (((rows) + BITS - 1) / BITS)
+#define bit_get(set, n) (((set)[(n) / BITS] >> ((n) % BITS)) & 1)
+#define bit_set(set, n) ((set)[(n) / BITS] |= (uint64_t)1 << ((n) % BITS))
+
+struct column
+{
+    char *name;
+    // JSON_NUMBER, JSON_STRING, JSON_BOOLEAN or JSON_NULL (no values)
+    unsigned char type;
+    union { double *numbers; unsigned *ids; };
+    // Booleans: values, numbers: cells holding a real (an integer otherwise)
+    uint64_t *bits;
+    uint64_t *nulls, *missing;
+};
+
+struct json_columns
+{
+    struct column *column;
+    size_t size, rows;
+    // Strings of the columns (the id is the position in 'symbol')
+    map_t *symbols;
+    char **symbol;
+    size_t symbol_count, symbol_room;
+};
+
+static void delete_columns(json_columns_t *columns)
+{
+    for (size_t i = 0; i < columns->size; i++)
+    {
+        struct column *column = &columns->column[i];
+
+        free(column->name);
+        if (column->type != JSON_BOOLEAN)
+        {
+            free(column->numbers);
+        }
+        free(column->bits);
+        free(column->nulls);
+        free(column->missing);
+    }
+    for (size_t i = 0; i < columns->symbol_count; i++)
+    {
+        free(columns->symbol[i]);
+    }
+    free(columns->symbol);
+    free(columns->column);
+    map_destroy(columns->symbols, NULL);
+    free(columns);
+}
+
+static json_columns_t *new_columns(size_t size, size_t rows)
+{
+    json_columns_t *columns = calloc(1, sizeof *columns);
+
+    if (columns == NULL)
+    {
+        return NULL;
+    }
+    columns->rows = rows;
+    if (!(columns->symbols = map_create(0)) ||
+        !(columns->column = calloc(size ? size : 1, sizeof *columns->column)))
+    {
+        delete_columns(columns);
+        return NULL;
+    }
+    return columns;
+}
+
+static int add_column(json_columns_t *columns, const char *name)
+{
+    struct column *column = &columns->column[columns->size];
+    size_t size = words(columns->rows) ? words(columns->rows) : 1;
+
+    if (!(column->name = string_clone(name)))
+    {
+        return 0;
+    }
+    column->type = JSON_NULL;
+    columns->size++;
+    return (column->nulls = calloc(size, sizeof(uint64_t))) &&
+           (column->missing = calloc(size, sizeof(uint64_t)));
+}
+
+/* Returns the id of 'str' in the symbol table, adding it if not found */
+static unsigned add_symbol(json_columns_t *columns, const char *str)
+{
+    void *id = map_search(columns->symbols, str);
+
+    if (id != NULL)
+    {
+        return (unsigned)((uintptr_t)id - 1);
+    }
+    if (columns->symbol_count == columns->symbol_room)
+    {
+        size_t room = columns->symbol_room ? columns->symbol_room * 2 : 64;
+        char **symbol = realloc(columns->symbol, sizeof(*symbol) * room);
+
+        if (symbol == NULL)
+        {
+            return JSON_NOT_FOUND;
+        }
+        columns->symbol = symbol;
+        columns->symbol_room = room;
+    }
+
+    char *text = string_clone(str);
+
+    // Ids are stored plus one, NULL is 'not found' for the map
+    if ((text == NULL) || (columns->symbol_count >= JSON_NOT_FOUND - 1) ||
+        !map_insert(columns->symbols, str, (void *)(uintptr_t)(columns->symbol_count + 1)))
+    {
+        free(text);
+        return JSON_NOT_FOUND;
+    }
+    columns->symbol[columns->symbol_count] = text;
+    return (unsigned)columns->symbol_count++;
+}
+
+/* The column takes the type of its first value which is not null */
+static int set_type(const json_columns_t *columns, struct column *column, unsigned char type)
+{
+    if (column->type == type)
+    {
+        return 1;
+    }
+    if (column->type != JSON_NULL)
+    {
+        return 0;
+    }
+
+    size_t rows = columns->rows ? columns->rows : 1;
+
+    switch (type)
+    {
+        case JSON_NUMBER:
+            column->numbers = calloc(rows, sizeof *column->numbers);
+            break;
+        case JSON_STRING:
+            column->ids = calloc(rows, sizeof *column->ids);
+            break;
+        default:
+            break;
+    }
+    if ((type != JSON_BOOLEAN) && (column->numbers == NULL))
+    {
+        return 0;
+    }
+    if (!(column->bits = calloc(words(rows), sizeof(uint64_t))))
+    {
+        return 0;
+    }
+    column->type = type;
+    return 1;
+}
+
+static int set_cell(json_columns_t *columns, struct column *column, size_t row,
+    const json_t *node)
+{
+    switch (node->type)
+    {
+        case JSON_NULL:
+            bit_set(column->nulls, row);
+            return 1;
+        case JSON_INTEGER:
+        case JSON_REAL:
+            if (!set_type(columns, column, JSON_NUMBER))
+            {
+                return 0;
+            }
+            column->numbers[row] = node->number;
+            if (node->type == JSON_REAL)
+            {
+                bit_set(column->bits, row);
+            }
+            return 1;
+        case JSON_TRUE:
+        case JSON_FALSE:
+            if (!set_type(columns, column, JSON_BOOLEAN))
+            {
+                return 0;
+            }
+            if (node->type == JSON_TRUE)
+            {
+                bit_set(column->bits, row);
+            }
+            return 1;
+        case JSON_STRING:
+            if (!set_type(columns, column, JSON_STRING))
+            {
+                return 0;
+            }
+            return (column->ids[row] = add_symbol(columns, node->string)) != JSON_NOT_FOUND;
+        default:
+            // Nested values
+            return 0;
+    }
+}
+
+/* Members are usually in the same order than the shape */
+static const json_t *find_member(const json_t *object, const char *name, size_t index)
+{
+    if (index < object->size)
+    {
+        const json_t *child = object->child[index];
+
+        if ((child->key == name) || !strcmp(child->key, name))
+        {
+            return child;
+        }
+    }
+    for (unsigned i = 0; i < object->size; i++)
+    {
+        if (!strcmp(object->child[i]->key, name))
+        {
+            return object->child[i];
+        }
+    }
+    return NULL;
+}
+
+static int add_row(json_columns_t *columns, size_t row, const json_t *object, int strict)
+{
+    if (object->type != JSON_OBJECT)
+    {
+        return 0;
+    }
+
+    size_t members = 0;
+
+    for (size_t i = 0; i < columns->size; i++)
+    {
+        struct column *column = &columns->column[i];
+        const json_t *node = find_member(object, column->name, i);
+
+        if (node == NULL)
+        {
+            bit_set(column->missing, row);
+        }
+        else if (set_cell(columns, column, row, node))
+        {
+            members++;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+    // A detected shape must hold all the members of each object
+    return !strict || (members == object->size);
+}
+
+/**
+ * Stores an array of objects by columns, the shape is given by 'names' (the
+ * first 'size' names) or taken from the first object when 'names' is NULL
+ * Returns NULL if the array does not fit (see the top of this file)
+ */
+json_columns_t *json_columns_create(const json_t *array, const char *names[], size_t size)
+{
+    if ((array == NULL) || (array->type != JSON_ARRAY))
+    {
+        return NULL;
+    }
+
+    const json_t *first = array->size ? array->child[0] : NULL;
+
+    if (names == NULL)
+    {
+        if ((first != NULL) && (first->type != JSON_OBJECT))
+        {
+            return NULL;
+        }
+        size = first ? first->size : 0;
+    }
+
+    json_columns_t *columns = new_columns(size, array->size);
+
+    if (columns == NULL)
+    {
+        return NULL;
+    }
+    for (size_t i = 0; i < size; i++)
+    {
+        const char *name = names ? names[i] : first->child[i]->key;
+
+        if ((name == NULL) || (json_columns_index(columns, name) != JSON_NOT_FOUND) ||
+            !add_column(columns, name))
+        {
+            delete_columns(columns);
+            return NULL;
+        }
+    }
+    for (size_t row = 0; row < array->size; row++)
+    {
+        if (!add_row(columns, row, array->child[row], names == NULL))
+        {
+            delete_columns(columns);
+            return NULL;
+        }
+    }
+    return columns;
+}
+
+size_t json_columns_rows(const json_columns_t *columns)
+{
+    return columns ? columns->rows : 0;
+}
+
+/* Number of columns */
+size_t json_columns_size(const json_columns_t *columns)
+{
+    return columns ? columns->size : 0;
+}
+
+const char *json_columns_name(const json_columns_t *columns, size_t index)
+{
+    if ((columns == NULL) || (index >= columns->size))
+    {
+        return NULL;
+    }
+    return columns->column[index].name;
+}
+
+/* Position of a column given its name or -1u if not found */
+unsigned json_columns_index(const json_columns_t *columns, const char *name)
+{
+    if ((columns != NULL) && (name != NULL))
+    {
+        for (size_t i = 0; i < columns->size; i++)
+        {
+            if (!strcmp(columns->column[i].name, name))
+            {
+                return (unsigned)i;
+            }
+        }
+    }
+    return JSON_NOT_FOUND;
+}
+
+/**
+ * Returns JSON_NUMBER, JSON_STRING, JSON_BOOLEAN, JSON_NULL (all the cells are
+ * null or missing) or JSON_UNDEFINED if 'index' is out of range
+ */
+unsigned json_columns_type(const json_columns_t *columns, size_t index)
+{
+    if ((columns == NULL) || (index >= columns->size))
+    {
+        return JSON_UNDEFINED;
+    }
+    return columns->column[index].type;
+}
+
+/* Contiguous values of a column of numbers ('rows' items), NULL otherwise */
+const double *json_columns_numbers(const json_columns_t *columns, size_t index)
+{
+    if (json_columns_type(columns, index) != JSON_NUMBER)
+    {
+        return NULL;
+    }
+    return columns->column[index].numbers;
+}
+
+/* Sum of a column of numbers, null and missing cells hold 0 */
+double json_columns_sum(const json_columns_t *columns, size_t index)
+{
+    const double *numbers = json_columns_numbers(columns, index);
+    double sum = 0;
+
+    if (numbers != NULL)
+    {
+        for (size_t row = 0; row < columns->rows; row++)
+        {
+            sum += numbers[row];
+        }
+    }
+    return sum;
+}
+
+/* Contiguous ids of a column of strings ('rows' items), NULL otherwise */
+const unsigned *json_columns_ids(const json_columns_t *columns, size_t index)
+{
+    if (json_columns_type(columns, index) != JSON_STRING)
+    {
+        return NULL;
+    }
+    return columns->column[index].ids;
+}
+
+/* String given its id */
+const char *json_columns_symbol(const json_columns_t *columns, unsigned id)
+{
+    if ((columns == NULL) || (id >= columns->symbol_count))
+    {
+        return NULL;
+    }
+    return columns->symbol[id];
+}
+
+/* Id of a string or -1u if no cell holds it (filters compare ids) */
+unsigned json_columns_lookup(const json_columns_t *columns, const char *str)
+{
+    void *id = columns ? map_search(columns->symbols, str) : NULL;
+
+    return id ? (unsigned)((uintptr_t)id - 1) : JSON_NOT_FOUND;
+}
+
+int json_columns_boolean(const json_columns_t *columns, size_t index, size_t row)
+{
+    if ((json_columns_type(columns, index) != JSON_BOOLEAN) || (row >= columns->rows))
+    {
+        return 0;
+    }
+    return (int)bit_get(columns->column[index].bits, row);
+}
+
+/* Returns 1 if the cell is null or the member is missing in that row */
+int json_columns_is_null(const json_columns_t *columns, size_t index, size_t row)
+{
+    if ((columns == NULL) || (index >= columns->size) || (row >= columns->rows))
+    {
+        return 0;
+    }
+
+    const struct column *column = &columns->column[index];
+
+    return bit_get(column->nulls, row) || bit_get(column->missing, row);
+}
+
+static json_t *new_cell(const json_columns_t *columns, const struct column *column,
+    size_t row)
+{
+    if (bit_get(column->nulls, row))
+    {
+        return json_new_null();
+    }
+    switch (column->type)
+    {
+        case JSON_NUMBER:
+            if (bit_get(column->bits, row))
+            {
+                return json_new_real(column->numbers[row]);
+            }
+            return json_new_integer(column->numbers[row]);
+        case JSON_STRING:
+            return json_new_string(columns->symbol[column->ids[row]]);
+        case JSON_BOOLEAN:
+            return json_new_boolean((int)bit_get(column->bits, row));
+        default:
+            return json_new_null();
+    }
+}
+
+/* Converts back to an array of objects (missing members are not added) */
+json_t *json_columns_tree(const json_columns_t *columns)
+{
+    if (columns == NULL)
+    {
+        return NULL;
+    }
+
+    json_t *array = json_new_array();
+
+    for (size_t row = 0; (array != NULL) && (row < columns->rows); row++)
+    {
+        json_t *object = json_new_object();
+
+        if (!json_array_push(array, JSON_TAIL, object))
+        {
+            json_delete(object);
+            goto error;
+        }
+        for (size_t i = 0; i < columns->size; i++)
+        {
+            const struct column *column = &columns->column[i];
+
+            if (bit_get(column->missing, row))
+            {
+                continue;
+            }
+
+            json_t *cell = new_cell(columns, column, row);
+
+            if (!json_object_push(object, JSON_TAIL, column->name, cell))
+            {
+                json_delete(cell);
+                goto error;
+            }
+        }
+    }
+    return array;
+error:
+    json_delete(array);
+    return NULL;
+}
+
+void json_columns_destroy(json_columns_t *columns)
+{
+    if (columns != NULL)
+    {
+        delete_columns(columns);
+    }
+}
@@ -0,0 +1,177 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+/*
+--------------------------------------------------------
+Structural hashes and sets of values
+--------------------------------------------------------
+- json_hash is consistent with json_equal: the type,
+  the size, the value and the members (keys included)
+  in order, the key of the node itself is not hashed,
+  integers and reals never compare equal, 0 and -0 do
+- A set indexes the children of a node by value, open
+  addressing with linear probing, each slot holds the
+  position of a child (equal hashes are confirmed with
+  json_equal), used by json_unique_children and by the
+  'enum' of compiled schemas
+--------------------------------------------------------
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "clib_math.h"
+#include "json_private.h"
+#include "json_reader.h"
+
+static unsigned long hash_mix(unsigned long hash, unsigned long value)
+{
+    return hash ^ (value + 0x9e3779b9UL + (hash << 6) + (hash >> 2));
+}
+
+static unsigned long hash_text(unsigned long hash, const char *str)
+{
+    unsigned long value = 5381;
+    unsigned char chr;
+
+    while ((chr = (unsigned char)*str++))
+    {
+        value = ((value << 5) + value) + chr;
+    }
+    return hash_mix(hash, value);
+}
+
+static unsigned long hash_node(unsigned long hash, const json_t *node, int keyed)
+{
+    hash = hash_mix(hash, node->type);
+    hash = hash_mix(hash, node->size);
+    if (keyed && (node->key != NULL))
+    {
+        hash = hash_text(hash, node->key);
+    }
+    switch (node->type)
+    {
+        case JSON_STRING:
+            return hash_text(hash, node->string);
+        case JSON_INTEGER:
+        case JSON_REAL:
+            // 0 == -0
+            if (node->number != 0)
+            {
+                unsigned long long bits;
+
+                memcpy(&bits, &node->number, sizeof bits);
+                hash = hash_mix(hash, (unsigned long)(bits ^ (bits >> 32)));
+            }
+            return hash;
+        default:
+            return hash;
+    }
+}
+
+/**
+ * Hashes a subtree in preorder, levels deeper than JSON_STACK_BASE are not
+ * hashed (no allocations, the hash stays consistent with json_equal)
+ */
+static unsigned long hash_tree(const json_t *node)
+{
+    struct json_stack stack = { 0 };
+    unsigned long hash = hash_node(5381, node, 0);
+
+    json_stack_push(&stack, node, NULL);
+    while (stack.size > 0)
+    {
+        struct json_frame *frame = json_stack_top(&stack);
+
+        if (frame->index == frame->node->size)
+        {
+            stack.size--;
+            continue;
+        }
+
+        const json_t *child = frame->node->child[frame->index++];
+
+        hash = hash_node(hash, child, 1);
+        if ((child->size > 0) && (stack.size < JSON_STACK_BASE))
+        {
+            json_stack_push(&stack, child, NULL);
+        }
+    }
+    return hash;
+}
+
+/* Returns a hash of a value, equal values (see json_equal) have equal hashes */
+unsigned long json_hash(const json_t *node)
+{
+    return node != NULL ? hash_tree(node) : 0;
+}
+
+/* Hashes the children of 'parent', the set is empty until json_hashset_insert */
+int json_hashset_init(struct json_hashset *set, const json_t *parent)
+{
+    size_t slots = next_pow2((size_t)parent->size * 2);
+
+    *set = (struct json_hashset){ .parent = parent, .mask = slots - 1 };
+    set->hashes = malloc(sizeof(*set->hashes) * (parent->size ? parent->size : 1));
+    set->slots = calloc(slots, sizeof *set->slots);
+    if ((set->hashes == NULL) || (set->slots == NULL))
+    {
+        json_hashset_free(set);
+        return 0;
+    }
+    for (unsigned i = 0; i < parent->size; i++)
+    {
+        set->hashes[i] = hash_tree(parent->child[i]);
+    }
+    return 1;
+}
+
+/* Looks for a value with a known hash */
+static unsigned find(const struct json_hashset *set, const json_t *node, unsigned long hash,
+    size_t *slot)
+{
+    for (*slot = hash & set->mask; set->slots[*slot] != 0; *slot = (*slot + 1) & set->mask)
+    {
+        unsigned index = set->slots[*slot] - 1;
+
+        if ((set->hashes[index] == hash) && (json_equal(set->parent->child[index], node) > 0))
+        {
+            return index;
+        }
+    }
+    return JSON_NOT_FOUND;
+}
+
+/**
+ * Adds the child at 'index' to the set, returns the position of an equal
+ * child already in the set (then the child is not added) or JSON_NOT_FOUND
+ */
+unsigned json_hashset_insert(struct json_hashset *set, unsigned index)
+{
+    size_t slot;
+    unsigned found = find(set, set->parent->child[index], set->hashes[index], &slot);
+
+    if (found == JSON_NOT_FOUND)
+    {
+        set->slots[slot] = index + 1;
+    }
+    return found;
+}
+
+/* Returns the position of a child equal to 'node' or JSON_NOT_FOUND */
+unsigned json_hashset_find(const struct json_hashset *set, const json_t *node)
+{
+    size_t slot;
+
+    return find(set, node, hash_tree(node), &slot);
+}
+
+void json_hashset_free(struct json_hashset *set)
+{
+    free(set->hashes);
+    free(set->slots);
+    set->hashes = NULL;
+    set->slots = NULL;
+}
@@ -0,0 +1,361 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+/*
+--------------------------------------------------------
+Hash index of the keys of large objects
+--------------------------------------------------------
+- Objects reaching JSON_KEYMAP_MIN members are indexed
+  (JSON_INDEXED), the map is stored in the slot placed
+  just before the first child: child[-1]
+- Open addressing with linear probing, each slot holds
+  the hash of a key and its position in the object
+- Duplicated keys are allowed, lookups return the first
+- Keys of members are stored in a json_keyref linking
+  the member to its object (JSON_KEYED), json_set_key
+  moves a renamed member to the slot of its new key
+- A map is stale when it can not grow or some key can
+  not be linked, lookups scan the object until a refill
+--------------------------------------------------------
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "clib_math.h"
+#include "clib_arena.h"
+#include "json_header.h"
+#include "json_private.h"
+
+struct json_keyslot
+{
+    unsigned hash;
+    unsigned index;     // Position + 1 (0 = empty slot)
+};
+
+struct json_keymap
+{
+    unsigned mask;      // Number of slots - 1
+    unsigned size;      // Number of keys
+    int stale;          // Not in use until the next refill
+    struct json_keyslot slot[];
+};
+
+static unsigned hash_key(const char *key, size_t length)
+{
+    return (unsigned)fnv1a_64(key, length);
+}
+
+static int equal_key(const char *a, const char *b, size_t length)
+{
+    // 'b' can be the same (interned) key
+    return ((a == b) || (strncmp(a, b, length) == 0)) && (a[length] == '\0');
+}
+
+/* Number of slots to index 'room' keys with a load factor <= 0.5 */
+static size_t slots(size_t room)
+{
+    return next_pow2(room < JSON_KEYMAP_MIN ? JSON_KEYMAP_MIN * 2 : room * 2);
+}
+
+static void put(struct json_keymap *map, unsigned hash, unsigned index)
+{
+    unsigned slot = hash & map->mask;
+
+    while (map->slot[slot].index != 0)
+    {
+        slot = (slot + 1) & map->mask;
+    }
+    map->slot[slot].hash = hash;
+    map->slot[slot].index = index + 1;
+    map->size++;
+}
+
+/* Links the key of 'child' to 'node', plain keys are copied into a keyref first */
+static int link_key(json_t *node, json_t *child, arena_t *arena)
+{
+    if (!(child->packed & JSON_KEYED))
+    {
+        size_t size = sizeof(struct json_keyref) + strlen(child->key) + 1;
+        struct json_keyref *ref = arena ? arena_alloc(arena, size) : malloc(size);
+
+        if (ref == NULL)
+        {
+            return 0;
+        }
+        strcpy(ref->key, child->key);
+        if (!(child->packed & JSON_BORROWED_KEY))
+        {
+            free(child->key);
+        }
+        child->key = ref->key;
+        child->packed = (unsigned char)(child->packed & ~JSON_BORROWED_KEY);
+        child->packed |= arena ? JSON_KEYED | JSON_BORROWED_KEY : JSON_KEYED;
+    }
+    json_keyref_of(child->key)->parent = node;
+    return 1;
+}
+
+static void fill(struct json_keymap *map, json_t *node, arena_t *arena)
+{
+    memset(map->slot, 0, sizeof(*map->slot) * (map->mask + 1));
+    map->size = 0;
+    map->stale = 0;
+    for (unsigned index = 0; index < node->size; index++)
+    {
+        json_t *child = node->child[index];
+
+        // A renamed member could not find the map
+        if (!link_key(node, child, arena))
+        {
+            map->stale = 1;
+        }
+        put(map, hash_key(child->key, strlen(child->key)), index);
+    }
+}
+
+static struct json_keymap *new_keymap(size_t count, arena_t *arena)
+{
+    size_t size = sizeof(struct json_keymap) + sizeof(struct json_keyslot) * count;
+    struct json_keymap *map = arena ? arena_alloc(arena, size) : malloc(size);
+
+    if (map != NULL)
+    {
+        map->mask = (unsigned)(count - 1);
+    }
+    return map;
+}
+
+/**
+ * Returns a new map indexing the children of 'node' with room for 'room' keys
+ * The map is allocated in 'arena' when not NULL
+ */
+struct json_keymap *json_keymap_create(json_t *node, size_t room, arena_t *arena)
+{
+    struct json_keymap *map = new_keymap(slots(room), arena);
+
+    if (map != NULL)
+    {
+        fill(map, node, arena);
+    }
+    return map;
+}
+
+/**
+ * Indexes an object with an owned array of children with room for 'room' nodes
+ * Returns 0 on failure, the object is left untouched
+ */
+int json_keymap_attach(json_t *node, size_t room)
+{
+    struct json_keymap *map = json_keymap_create(node, room, NULL);
+
+    if (map == NULL)
+    {
+        return 0;
+    }
+
+    json_t **block = realloc(node->child, sizeof(*block) * (room + 1));
+
+    if (block == NULL)
+    {
+        free(map);
+        return 0;
+    }
+    memmove(block + 1, block, sizeof(*block) * node->size);
+    node->child = block + 1;
+    json_keymap_of(node) = map;
+    node->packed |= JSON_INDEXED;
+    return 1;
+}
+
+/* Releases the map of an indexed object (not the block of children) */
+void json_keymap_destroy(json_t *node)
+{
+    if (!(node->packed & JSON_BORROWED_CHILD))
+    {
+        free(json_keymap_of(node));
+    }
+}
+
+/* Refills the map after reordering the children, grows it if needed */
+void json_keymap_reset(json_t *node)
+{
+    struct json_keymap *map = json_keymap_of(node);
+    size_t count = slots(node->size);
+
+    if (count > (size_t)map->mask + 1)
+    {
+        // Only owned maps can grow (writers own the children before pushing)
+        struct json_keymap *temp = realloc(map, sizeof(*map) + sizeof(struct json_keyslot) * count);
+
+        if (temp == NULL)
+        {
+            map->stale = 1;
+            return;
+        }
+        map = temp;
+        map->mask = (unsigned)(count - 1);
+        json_keymap_of(node) = map;
+    }
+    fill(map, node, NULL);
+}
+
+/* Adds the displacement 'delta' to the positions greater or equal than 'index' */
+static void shift(struct json_keymap *map, unsigned index, unsigned delta)
+{
+    for (unsigned slot = 0; slot <= map->mask; slot++)
+    {
+        if (map->slot[slot].index > index)
+        {
+            map->slot[slot].index += delta;
+        }
+    }
+}
+
+/* Indexes the child already inserted at position 'index' */
+void json_keymap_insert(json_t *node, unsigned index)
+{
+    struct json_keymap *map = json_keymap_of(node);
+
+    // A refill already includes the new child
+    if (map->stale || (((size_t)map->size + 1) * 2 > (size_t)map->mask + 1))
+    {
+        json_keymap_reset(node);
+        return;
+    }
+    if (index < node->size - 1)
+    {
+        shift(map, index, 1);
+    }
+    json_keymap_link(node, index);
+}
+
+/* Backward shift deletion: moves back the entries displaced by the one at 'slot' */
+static void erase(struct json_keymap *map, unsigned slot)
+{
+    for (unsigned next = slot;;)
+    {
+        next = (next + 1) & map->mask;
+        if (map->slot[next].index == 0)
+        {
+            break;
+        }
+
+        unsigned home = map->slot[next].hash & map->mask;
+
+        if (((next - home) & map->mask) >= ((next - slot) & map->mask))
+        {
+            map->slot[slot] = map->slot[next];
+            slot = next;
+        }
+    }
+    map->slot[slot].index = 0;
+    map->size--;
+}
+
+/* Unindexes the child at position 'index' (still in place) */
+void json_keymap_remove(json_t *node, unsigned index)
+{
+    if (json_keymap_of(node)->stale)
+    {
+        json_keymap_reset(node);
+    }
+
+    struct json_keymap *map = json_keymap_of(node);
+
+    if (map->stale)
+    {
+        return;
+    }
+
+    const char *key = node->child[index]->key;
+    unsigned slot = hash_key(key, strlen(key)) & map->mask;
+
+    while (map->slot[slot].index != index + 1)
+    {
+        slot = (slot + 1) & map->mask;
+    }
+    erase(map, slot);
+    shift(map, index + 1, -1u);
+}
+
+/* Position of the first child matching [key, key + length) or JSON_NOT_FOUND */
+unsigned json_keymap_find(const json_t *node, const char *key, size_t length)
+{
+    const struct json_keymap *map = json_keymap_of(node);
+    unsigned hash = hash_key(key, length);
+
+    if (map->stale)
+    {
+        for (unsigned index = 0; index < node->size; index++)
+        {
+            if (equal_key(node->child[index]->key, key, length))
+            {
+                return index;
+            }
+        }
+        return JSON_NOT_FOUND;
+    }
+
+    unsigned slot = hash & map->mask;
+    unsigned found = 0;
+
+    // Keep probing, a duplicated key can be stored before the first one
+    while (map->slot[slot].index != 0)
+    {
+        unsigned index = map->slot[slot].index;
+
+        if ((map->slot[slot].hash == hash) && ((found == 0) || (index < found)) &&
+            equal_key(node->child[index - 1]->key, key, length))
+        {
+            found = index;
+        }
+        slot = (slot + 1) & map->mask;
+    }
+    return found - 1;
+}
+
+/**
+ * Unindexes the member 'child' before renaming it, returns its position to be
+ * passed to json_keymap_link once the new key is set (JSON_NOT_FOUND if stale)
+ */
+unsigned json_keymap_unlink(json_t *node, const json_t *child)
+{
+    struct json_keymap *map = json_keymap_of(node);
+
+    if (map->stale)
+    {
+        return JSON_NOT_FOUND;
+    }
+
+    unsigned slot = hash_key(child->key, strlen(child->key)) & map->mask;
+
+    while (map->slot[slot].index != 0)
+    {
+        unsigned index = map->slot[slot].index - 1;
+
+        if (node->child[index] == child)
+        {
+            erase(map, slot);
+            return index;
+        }
+        slot = (slot + 1) & map->mask;
+    }
+    return JSON_NOT_FOUND;
+}
+
+/* Indexes the child at position 'index' (not in the map) under its current key */
+void json_keymap_link(json_t *node, unsigned index)
+{
+    struct json_keymap *map = json_keymap_of(node);
+    json_t *child = node->child[index];
+
+    if (!link_key(node, child, NULL))
+    {
+        map->stale = 1;
+        return;
+    }
+    put(map, hash_key(child->key, strlen(child->key)), index);
+}
@@ -0,0 +1,76 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+/*
+--------------------------------------------------------
+Interned keys
+--------------------------------------------------------
+- When a table is set with json_set_keys, the keys of
+  the members created by the parser (out of in-situ
+  parsing), json_set_key and json_object_push point to
+  a single copy stored in the table
+- Shared keys are immutable and flagged as borrowed in
+  the nodes (JSON_BORROWED_KEY), the table must outlive
+  every node using it
+- Keys with escape sequences are not interned by the
+  parser (they are decoded in the node)
+- The table is guarded by a mutex, it can be shared by
+  the workers of json_parse_lines
+--------------------------------------------------------
+*/
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "json_private.h"
+#include "json_keys.h"
+
+static json_keys_t *keys;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+json_keys_t *json_keys_create(size_t size)
+{
+    return map_create(size);
+}
+
+void json_keys_destroy(json_keys_t *table)
+{
+    if (table == keys)
+    {
+        keys = NULL;
+    }
+    map_destroy(table, NULL);
+}
+
+size_t json_keys_size(const json_keys_t *table)
+{
+    return map_size(table);
+}
+
+/* Sets the table used to intern keys (NULL = keys are not shared) */
+void json_set_keys(json_keys_t *table)
+{
+    keys = table;
+}
+
+json_keys_t *json_get_keys(void)
+{
+    return keys;
+}
+
+/* Returns the interned copy of the first 'length' bytes of 'key' */
+char *json_keys_intern(json_keys_t *table, const char *key, size_t length)
+{
+    pthread_mutex_lock(&mutex);
+
+    const char *text = map_intern(table, key, length);
+
+    pthread_mutex_unlock(&mutex);
+    // Shared keys are never written through the nodes
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-qual"
+    return (char *)text;
+#pragma GCC diagnostic pop
+}
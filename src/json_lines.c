@@ -0,0 +1,389 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+/*
+--------------------------------------------------------
+JSON Lines (one document per line)
+--------------------------------------------------------
+- The input is split in chunks ending on a newline and
+  the chunks are parsed by a pool of workers (one per
+  online core)
+- Records are delivered in the original order from the
+  calling thread, workers only parse a window of chunks
+  ahead of the consumer to keep memory bounded
+- Blank lines are skipped
+- On a syntax error, 'line' is the line number in the
+  input and 'column' the column in that line
+--------------------------------------------------------
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "clib_scan.h"
+#include "clib_stream.h"
+#include "json_writer.h"
+#include "json_lines.h"
+
+// Smaller chunks are not worth a thread, larger chunks delay the consumer
+#define CHUNK_MIN (256 * 1024)
+#define CHUNK_MAX (8 * 1024 * 1024)
+#define CHUNKS_PER_WORKER 4
+
+struct record
+{
+    json_t *node;
+    size_t line;        // Line in the chunk
+};
+
+struct chunk
+{
+    const char *str, *end;
+    struct record *record;
+    size_t records, room;
+    size_t lines;       // Lines started in the chunk
+    json_error_t error; // Line in the chunk when failed
+    int failed;
+    int done;
+};
+
+typedef struct
+{
+    struct chunk *chunk;
+    size_t chunks;
+    // Next chunk to parse and number of chunks already delivered
+    size_t next, consumed;
+    // Chunks that can be parsed ahead of the consumer
+    size_t window;
+    int stop;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} pool_t;
+
+static void clear_error(json_error_t *error)
+{
+    if (error != NULL)
+    {
+        error->line = error->column = 0;
+    }
+}
+
+static int add_record(struct chunk *chunk, json_t *node, size_t line)
+{
+    if (chunk->records == chunk->room)
+    {
+        size_t room = chunk->room ? chunk->room * 2 : 64;
+        struct record *record = realloc(chunk->record, sizeof(*record) * room);
+
+        if (record == NULL)
+        {
+            return 0;
+        }
+        chunk->record = record;
+        chunk->room = room;
+    }
+    chunk->record[chunk->records].node = node;
+    chunk->record[chunk->records].line = line;
+    chunk->records++;
+    return 1;
+}
+
+static void parse_chunk(struct chunk *chunk)
+{
+    const char *str = chunk->str;
+
+    while (str < chunk->end)
+    {
+        const char *eol = memchr(str, '\n', (size_t)(chunk->end - str));
+        const char *end = eol ? eol : chunk->end;
+
+        chunk->lines++;
+        if (scan_spaces(str, end) < end)
+        {
+            json_error_t error;
+            json_t *node = json_parse_n(str, (size_t)(end - str), &error);
+
+            if (node == NULL)
+            {
+                // Lines do not contain newlines, json_parse_n reports line 1
+                if (error.line != 0)
+                {
+                    error.line = (int)chunk->lines;
+                }
+                chunk->error = error;
+                chunk->failed = 1;
+                return;
+            }
+            if (!add_record(chunk, node, chunk->lines))
+            {
+                json_delete(node);
+                clear_error(&chunk->error);
+                chunk->failed = 1;
+                return;
+            }
+        }
+        str = eol ? eol + 1 : chunk->end;
+    }
+}
+
+static void delete_records(struct chunk *chunk, size_t from)
+{
+    for (size_t i = from; i < chunk->records; i++)
+    {
+        json_delete(chunk->record[i].node);
+    }
+    free(chunk->record);
+    chunk->record = NULL;
+    chunk->records = chunk->room = 0;
+}
+
+static void *worker(void *data)
+{
+    pool_t *pool = data;
+
+    pthread_mutex_lock(&pool->mutex);
+    for (;;)
+    {
+        while (!pool->stop && (pool->next < pool->chunks) &&
+               (pool->next >= pool->consumed + pool->window))
+        {
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+        }
+        if (pool->stop || (pool->next >= pool->chunks))
+        {
+            break;
+        }
+
+        struct chunk *chunk = &pool->chunk[pool->next++];
+
+        pthread_mutex_unlock(&pool->mutex);
+        parse_chunk(chunk);
+        pthread_mutex_lock(&pool->mutex);
+        chunk->done = 1;
+        pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+static size_t online_cores(void)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return cores > 1 ? (size_t)cores : 1;
+}
+
+/* Splits [str, str + length) in chunks ending on a newline */
+static struct chunk *split(const char *str, size_t length, size_t workers, size_t *chunks)
+{
+    size_t size = length / (workers * CHUNKS_PER_WORKER);
+
+    size = size < CHUNK_MIN ? CHUNK_MIN : size > CHUNK_MAX ? CHUNK_MAX : size;
+
+    struct chunk *chunk = calloc(length / size + 1, sizeof *chunk);
+
+    if (chunk == NULL)
+    {
+        return NULL;
+    }
+
+    const char *end = str + length;
+    size_t count = 0;
+
+    while (str < end)
+    {
+        const char *eol = (size_t)(end - str) > size ? memchr(str + size, '\n', (size_t)(end - str) - size) : NULL;
+
+        chunk[count].str = str;
+        chunk[count].end = eol ? eol + 1 : end;
+        str = chunk[count++].end;
+    }
+    *chunks = count;
+    return chunk;
+}
+
+/* Starts up to 'count' workers, returns the number of workers running */
+static size_t start(pool_t *pool, pthread_t *thread, size_t count)
+{
+    size_t started = 0;
+
+    while ((started < count) && (pthread_create(&thread[started], NULL, worker, pool) == 0))
+    {
+        started++;
+    }
+    return started;
+}
+
+static void stop(pool_t *pool, pthread_t *thread, size_t threads)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+    for (size_t i = 0; i < threads; i++)
+    {
+        pthread_join(thread[i], NULL);
+    }
+}
+
+/**
+ * Parses each line of [str, str + length) and passes the documents to
+ * 'callback' in order along with their line number, the callback owns the
+ * documents and returns 0 to stop. Returns 1 if all the lines were parsed,
+ * on a syntax error 'error' gets the line in the input and the column in
+ * that line (line 0 on memory errors or if the callback stopped)
+ */
+int json_parse_lines_callback(const char *str, size_t length,
+    json_lines_callback callback, void *data, json_error_t *error)
+{
+    clear_error(error);
+    if ((str == NULL) || (callback == NULL))
+    {
+        return 0;
+    }
+
+    size_t workers = online_cores();
+    pool_t pool = { .window = workers * 2 };
+
+    if (!(pool.chunk = split(str, length, workers, &pool.chunks)))
+    {
+        return 0;
+    }
+
+    pthread_t *thread = NULL;
+    size_t threads = 0;
+
+    // A single chunk is parsed by the caller
+    if ((workers > 1) && (pool.chunks > 1))
+    {
+        pthread_mutex_init(&pool.mutex, NULL);
+        pthread_cond_init(&pool.cond, NULL);
+        if ((thread = malloc(sizeof(*thread) * workers)))
+        {
+            threads = start(&pool, thread, workers < pool.chunks ? workers : pool.chunks);
+        }
+    }
+
+    size_t line = 0;
+    int done = 1;
+
+    for (size_t i = 0; done && (i < pool.chunks); i++)
+    {
+        struct chunk *chunk = &pool.chunk[i];
+
+        if (threads == 0)
+        {
+            parse_chunk(chunk);
+        }
+        else
+        {
+            pthread_mutex_lock(&pool.mutex);
+            while (!chunk->done)
+            {
+                pthread_cond_wait(&pool.cond, &pool.mutex);
+            }
+            pthread_mutex_unlock(&pool.mutex);
+        }
+        for (size_t j = 0; j < chunk->records; j++)
+        {
+            if (!callback(chunk->record[j].node, line + chunk->record[j].line, data))
+            {
+                delete_records(chunk, j + 1);
+                done = 0;
+                break;
+            }
+        }
+        if (done && chunk->failed)
+        {
+            if ((error != NULL) && (chunk->error.line != 0))
+            {
+                error->line = (int)(line + (size_t)chunk->error.line);
+                error->column = chunk->error.column;
+            }
+            done = 0;
+        }
+        free(chunk->record);
+        chunk->record = NULL;
+        chunk->records = 0;
+        line += chunk->lines;
+        if (threads > 0)
+        {
+            pthread_mutex_lock(&pool.mutex);
+            pool.consumed++;
+            pthread_cond_broadcast(&pool.cond);
+            pthread_mutex_unlock(&pool.mutex);
+        }
+    }
+    if ((workers > 1) && (pool.chunks > 1))
+    {
+        stop(&pool, thread, threads);
+        pthread_cond_destroy(&pool.cond);
+        pthread_mutex_destroy(&pool.mutex);
+    }
+    // Chunks parsed ahead when stopping
+    for (size_t i = 0; i < pool.chunks; i++)
+    {
+        delete_records(&pool.chunk[i], 0);
+    }
+    free(pool.chunk);
+    free(thread);
+    return done;
+}
+
+static int push_line(json_t *node, size_t line, void *array)
+{
+    (void)line;
+    if (json_array_push_back(array, node) == NULL)
+    {
+        json_delete(node);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Parses each line of [str, str + length) in parallel and returns an array
+ * with the documents in the original order (see json_parse_lines_callback)
+ */
+json_t *json_parse_lines(const char *str, size_t length, json_error_t *error)
+{
+    json_t *array = str ? json_new_array() : NULL;
+
+    if (array == NULL)
+    {
+        clear_error(error);
+        return NULL;
+    }
+    if (!json_parse_lines_callback(str, length, push_line, array, error))
+    {
+        json_delete(array);
+        return NULL;
+    }
+    return array;
+}
+
+json_t *json_parse_lines_file(const char *path, json_error_t *error)
+{
+    size_t length;
+    const char *map = path ? file_map(path, &length) : NULL;
+
+    if (map != NULL)
+    {
+        json_t *node = json_parse_lines(map, length, error);
+
+        file_unmap(map, length);
+        return node;
+    }
+
+    char *str = path ? file_read(path) : NULL;
+    json_t *node = json_parse_lines(str, str ? strlen(str) : 0, error);
+
+    free(str);
+    return node;
+}
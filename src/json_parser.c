@@ -7,21 +7,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <assert.h>
 #include <errno.h>
-#include <math.h>
 #include "clib_math.h"
+#include "clib_arena.h"
+#include "clib_number.h"
 #include "clib_stream.h"
+#include "clib_scan.h"
 #include "clib_unicode.h"
 #include "json_private.h"
 #include "json_writer.h"
+#include "json_keys.h"
+#include "json_stream.h"
 #include "json_parser.h"
 
 /**
  * The library does not store the parent of each node. As a result,
- * it requires traversing the hierarchy through recursive calls to
- * process the data correctly.
- * A very high depth limit is set to protect against recursive attacks.
+ * the iterables being parsed are kept in an explicit stack (no recursive
+ * calls, deep documents do not consume the stack of the thread).
+ * A very high depth limit is set to protect against hostile input.
  */
 static unsigned short max_depth = (unsigned short)-1;
 
@@ -63,93 +66,324 @@ static void set_error(json_error_t *error, const char *str, const char *end)
     }
 }
 
-static json_t *append(json_t *parent, json_t *child)
+typedef struct
 {
-    // Space for inner nodes is incremented when size is a power of 2
-    unsigned size = next_size(parent->size);
+    // End of the text being parsed
+    const char *end;
+    // Nodes are allocated in 'arena' when it is not NULL, in the heap otherwise
+    arena_t *arena;
+    // Strings are decoded in place when 'source' is not NULL (in-situ parsing)
+    char *source;
+    // In-situ strings containing escape sequences, decoded on success
+    char **pending;
+    size_t pendings, pending_room;
+    // In-situ objects whose keymaps must be refilled once keys are decoded
+    json_t **refill;
+    size_t refills, refill_room;
+    // Scratch stack where the children of the open iterables are collected
+    json_t **stack;
+    size_t size, room;
+    // Iterables currently open and the base of their children in the scratch stack
+    struct { json_t *node; size_t base; } *open;
+    size_t depth, open_room;
+    // Raw key of the next member, stored along with its node by new_node
+    const char *key, *key_end;
+    // Table of interned keys (see json_keys.c), NULL when keys are not shared
+    struct map *keys;
+    // JSON_BORROWED_* bits of the nodes
+    unsigned char borrowed;
+} parser_t;
 
-    if (size > parent->size)
+/**
+ * In-situ strings are terminated in place (the closing quote is replaced by
+ * '\0'), strings with escape sequences are decoded once the whole document is
+ * parsed in order to keep the source readable when reporting errors.
+ */
+static char *insitu_string(parser_t *parser, const char *str, const char *end)
+{
+    char *text = parser->source + (str - parser->source);
+
+    text[end - str] = '\0';
+    if (memchr(str, '\\', (size_t)(end - str)) == NULL)
+    {
+        return text;
+    }
+    if (parser->pendings == parser->pending_room)
     {
-        json_t **temp = realloc(parent->child, sizeof(*temp) * size);
+        size_t room = parser->pending_room ? parser->pending_room * 2 : 64;
+        char **pending = realloc(parser->pending, sizeof(*pending) * room);
 
-        if (temp == NULL)
+        if (pending == NULL)
         {
             return NULL;
         }
-        parent->child = temp;
+        parser->pending = pending;
+        parser->pending_room = room;
     }
-    assert(parent->child != NULL);
-    parent->child[parent->size++] = child;
-    child->packed = 1;
-    return child;
+    parser->pending[parser->pendings++] = text;
+    return text;
 }
 
-static json_t *new_node(unsigned char type)
+/**
+ * Returns a new node with the pending key and the raw string 'str' (if any)
+ * Out of in-situ parsing the key (in a keyref) and the string are decoded right
+ * after the node in the same allocation (flagged as borrowed, they are released
+ * along with the node), no extra blocks are needed for short keys and strings.
+ * Keys without escape sequences point to the table of interned keys if any.
+ */
+static json_t *new_node(parser_t *parser, unsigned char type,
+    const char *str, const char *end)
 {
-    json_t *node = calloc(1, sizeof *node);
+    const char *key = parser->key;
+    size_t length = key ? (size_t)(parser->key_end - key) : 0;
+    size_t size = sizeof(json_t);
+    char *shared = NULL;
 
-    if (node != NULL)
+    parser->key = NULL;
+    if (parser->source == NULL)
+    {
+        if (key && parser->keys && !memchr(key, '\\', length))
+        {
+            if ((shared = json_keys_intern(parser->keys, key, length)) == NULL)
+            {
+                return NULL;
+            }
+        }
+        size += key && !shared ? sizeof(struct json_keyref) + length + 1 : 0;
+        size += str ? (size_t)(end - str) + 1 : 0;
+    }
+
+    json_t *node = parser->arena ? arena_alloc(parser->arena, size) : malloc(size);
+
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    *node = (json_t){ .packed = parser->borrowed, .type = type };
+    if (parser->source != NULL)
+    {
+        if ((key && !(node->key = insitu_string(parser, key, parser->key_end))) ||
+            (str && !(node->string = insitu_string(parser, str, end))))
+        {
+            free(node);
+            return NULL;
+        }
+        return node;
+    }
+
+    char *text = (char *)(node + 1);
+
+    if (shared != NULL)
+    {
+        node->key = shared;
+        node->packed |= JSON_BORROWED_KEY;
+    }
+    else if (key != NULL)
+    {
+        struct json_keyref *ref = (struct json_keyref *)(void *)text;
+
+        ref->parent = NULL;
+        node->key = ref->key;
+        node->packed |= JSON_BORROWED_KEY | JSON_KEYED;
+        text = ref->key + decode_string(ref->key, key, parser->key_end) + 1;
+    }
+    if (str != NULL)
     {
-        node->type = type;
+        node->string = text;
+        node->packed |= JSON_BORROWED_STRING;
+        decode_string(text, str, end);
     }
     return node;
 }
 
-static char *new_string(const char *str, const char *end)
+/* Returns 1 if some key of an in-situ object contains escape sequences */
+static int pending_keys(const parser_t *parser, const json_t *node)
 {
-    char *text = malloc((size_t)(end - str) + 1);
+    if (parser->source != NULL)
+    {
+        for (unsigned i = 0; i < node->size; i++)
+        {
+            if (strchr(node->child[i]->key, '\\'))
+            {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
 
-    if (text == NULL)
+/* Keymaps of in-situ objects are created after decoding the keys */
+static int add_refill(parser_t *parser, json_t *node)
+{
+    if (parser->refills == parser->refill_room)
     {
-        return NULL;
+        size_t room = parser->refill_room ? parser->refill_room * 2 : 16;
+        json_t **refill = realloc(parser->refill, sizeof(*refill) * room);
+
+        if (refill == NULL)
+        {
+            return 0;
+        }
+        parser->refill = refill;
+        parser->refill_room = room;
     }
+    parser->refill[parser->refills++] = node;
+    return 1;
+}
 
-    char *ptr = text;
+static void delete_node(const parser_t *parser, json_t *node)
+{
+    if (parser->arena == NULL)
+    {
+        json_delete(node);
+    }
+}
 
-    while (str < end)
+/* Pushes a parsed child into the scratch stack */
+static int push(parser_t *parser, json_t *child)
+{
+    if (parser->size == parser->room)
     {
-        if (str[0] != '\\')
+        size_t room = parser->room ? parser->room * 2 : 64;
+        json_t **stack = realloc(parser->stack, sizeof(*stack) * room);
+
+        if (stack == NULL)
         {
-            *ptr++ = *str;
-            str += 1;
+            return 0;
         }
-        else if (str[1] != 'u')
+        parser->stack = stack;
+        parser->room = room;
+    }
+    parser->stack[parser->size++] = child;
+    return 1;
+}
+
+/* Pushes an iterable into the open stack, its children start at the top of the scratch stack */
+static int open_node(parser_t *parser, json_t *node)
+{
+    if (parser->depth == parser->open_room)
+    {
+        size_t room = parser->open_room ? parser->open_room * 2 : 32;
+        void *open = realloc(parser->open, sizeof(*parser->open) * room);
+
+        if (open == NULL)
         {
-            *ptr++ = decode_esc(str + 1);
-            str += 2;
+            return 0;
         }
-        else
+        parser->open = open;
+        parser->open_room = room;
+    }
+    parser->open[parser->depth].node = node;
+    parser->open[parser->depth].base = parser->size;
+    parser->depth++;
+    return 1;
+}
+
+/**
+ * Moves the children collected since 'base' from the scratch stack to 'parent'
+ * The array is allocated at once, with room for the next power of 2 on heap
+ * nodes (the same layout expected by the writer when pushing new nodes)
+ * Large objects get a keymap in front of the array (see json_keymap.c)
+ */
+static int pack(parser_t *parser, json_t *parent, size_t base)
+{
+    size_t size = parser->size - base;
+
+    if (size == 0)
+    {
+        return 1;
+    }
+    if (size > (unsigned)-1)
+    {
+        return 0;
+    }
+
+    size_t header = (parent->type == JSON_OBJECT) && (size >= JSON_KEYMAP_MIN) ? 1 : 0;
+    json_t **block = parser->arena
+        ? arena_alloc(parser->arena, sizeof(*block) * (size + header))
+        : malloc(sizeof(*block) * (next_pow2(size) + header));
+
+    if (block == NULL)
+    {
+        return 0;
+    }
+
+    json_t **child = block + header;
+
+    memcpy(child, parser->stack + base, sizeof(*child) * size);
+    parent->child = child;
+    parent->size = (unsigned)size;
+    if (header)
+    {
+        // Keys with escape sequences are copied into keyrefs once decoded
+        if (pending_keys(parser, parent)
+            ? (json_keymap_of(parent) = NULL, !add_refill(parser, parent))
+            : !(json_keymap_of(parent) = json_keymap_create(parent, size, parser->arena)))
         {
-            ptr += decode_hex(str + 2, ptr);
-            str += 6;
+            // Children are released by the caller on failure
+            if (parser->arena == NULL)
+            {
+                free(json_keymap_of(parent));
+                free(block);
+            }
+            parent->child = NULL;
+            parent->size = 0;
+            return 0;
         }
+        parent->packed |= JSON_INDEXED;
     }
-    *ptr = '\0';
-    return text;
+    // Flagged once packed, the caller can not release packed nodes on failure
+    for (size_t i = 0; i < size; i++)
+    {
+        child[i]->packed |= JSON_PACKED;
+    }
+    parser->size = base;
+    return 1;
 }
 
-static const char *skip_spaces(const char *str)
+/* Discards the children collected since 'base' on failure */
+static void discard(parser_t *parser, size_t base)
 {
-    while (is_space(*str))
+    if (parser->arena == NULL)
+    {
+        for (size_t i = base; i < parser->size; i++)
+        {
+            json_delete(parser->stack[i]);
+        }
+    }
+    parser->size = base;
+}
+
+/* Tokens are usually followed by none or one space, longer runs are vectorized */
+static const char *skip_spaces(const parser_t *parser, const char *str)
+{
+    if ((str < parser->end) && is_space(*str))
     {
         str++;
+        if ((str < parser->end) && is_space(*str))
+        {
+            return scan_spaces(str + 1, parser->end);
+        }
     }
     return str;
 }
 
-static const char *scan_string(const char *str)
+/* Returns the closing quote or the position of an invalid character */
+static const char *scan_string(const parser_t *parser, const char *str)
 {
-    while ((*str != '\"') && !is_cntrl(*str))
+    const char *end = parser->end;
+
+    while ((str = scan_quotes(str, end)) < end)
     {
         if (*str != '\\')
         {
-            str += 1;
+            break;
         }
-        else if (is_esc(str + 1))
+        if ((end - str > 1) && is_esc(str + 1))
         {
             str += 2;
         }
-        else if (is_hex(str + 1))
+        else if ((end - str > 5) && is_hex(str + 1))
         {
             str += 6;
         }
@@ -161,283 +395,690 @@ static const char *scan_string(const char *str)
     return str;
 }
 
-static json_t *parse(const char **, unsigned short);
+/* Character at 'str' or '\0' at the end of the text (the text is not terminated) */
+static char peek(const parser_t *parser, const char *str)
+{
+    return str < parser->end ? *str : '\0';
+}
+
+static int is_quote(const parser_t *parser, const char *str)
+{
+    return peek(parser, str) == '"';
+}
+
+static int is_literal(const parser_t *parser, const char *str, const char *name, size_t length)
+{
+    return ((size_t)(parser->end - str) >= length) && !memcmp(str, name, length);
+}
 
-static char *parse_key(const char **str)
+/* Scans a key, it is stored by the next call to new_node */
+static int parse_key(parser_t *parser, const char **str)
 {
-    if (**str != '"')
+    if (!is_quote(parser, *str))
     {
-        return NULL;
+        return 0;
     }
 
     const char *key = ++*str;
-    const char *end = scan_string(*str);
+    const char *end = scan_string(parser, *str);
+
+    if (!is_quote(parser, end))
+    {
+        *str = end;
+        return 0;
+    }
+    *str = skip_spaces(parser, end + 1);
+    if (peek(parser, *str) != ':')
+    {
+        return 0;
+    }
+    *str = skip_spaces(parser, ++*str);
+    parser->key = key;
+    parser->key_end = end;
+    return 1;
+}
 
-    if (*end != '"')
+static json_t *parse_string(parser_t *parser, const char **str)
+{
+    const char *end = scan_string(parser, ++*str);
+
+    if (!is_quote(parser, end))
     {
         *str = end;
         return NULL;
     }
-    *str = skip_spaces(end + 1);
-    if (**str != ':')
+
+    json_t *node = new_node(parser, JSON_STRING, *str, end);
+
+    if (node == NULL)
     {
         return NULL;
     }
-    *str = skip_spaces(++*str);
-    return new_string(key, end);
+    *str = skip_spaces(parser, end + 1);
+    return node;
 }
 
-static json_t *parse_object(const char **str, unsigned short depth)
+static json_t *parse_number(parser_t *parser, const char **str)
 {
-    json_t *parent = new_node(JSON_OBJECT);
+    const char *end = *str;
+    double number;
+    int integer;
 
-    if (parent == NULL)
+    // On syntax errors 'end' points to the first invalid character
+    if (!number_parse(&end, parser->end, &number, &integer))
     {
+        *str = end;
         return NULL;
     }
 
-    *str = skip_spaces(++*str);
+    json_t *node = new_node(parser, JSON_REAL, NULL, NULL);
 
-    int trailing_comma = 0;
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    node->number = number;
+    // Differs from the standard, which only considers 'number' as a numeric
+    // type. Here, we classify nodes as either 'real' or 'integer'.
+    // Safe integers are numbers within the range of -2^52 to +2^52 (inclusive)
+    if (integer && IS_SAFE_INTEGER(number))
+    {
+        node->type = JSON_INTEGER;
+    }
+    *str = skip_spaces(parser, end);
+    return node;
+}
 
-    while (**str != '}')
+static json_t *parse_true(parser_t *parser, const char **str)
+{
+    if (!is_literal(parser, *str, "true", 4))
     {
-        if (((parent->size > 0) && (trailing_comma == 0)) || (depth >= max_depth))
-        {
-            json_delete(parent);
-            return NULL;
-        }
+        return NULL;
+    }
+    *str = skip_spaces(parser, *str + 4);
+    return new_node(parser, JSON_TRUE, NULL, NULL);
+}
+
+static json_t *parse_false(parser_t *parser, const char **str)
+{
+    if (!is_literal(parser, *str, "false", 5))
+    {
+        return NULL;
+    }
+    *str = skip_spaces(parser, *str + 5);
+    return new_node(parser, JSON_FALSE, NULL, NULL);
+}
+
+static json_t *parse_null(parser_t *parser, const char **str)
+{
+    if (!is_literal(parser, *str, "null", 4))
+    {
+        return NULL;
+    }
+    *str = skip_spaces(parser, *str + 4);
+    return new_node(parser, JSON_NULL, NULL, NULL);
+}
 
-        char *key = parse_key(str);
+/* Creates an iterable and pushes it to the open stack */
+static json_t *parse_open(parser_t *parser, const char **str, unsigned char type)
+{
+    json_t *node = new_node(parser, type, NULL, NULL);
 
-        if (key == NULL)
-        {
-            json_delete(parent);
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    if (!open_node(parser, node))
+    {
+        delete_node(parser, node);
+        return NULL;
+    }
+    *str = skip_spaces(parser, ++*str);
+    return node;
+}
+
+static json_t *parse_value(parser_t *parser, const char **str)
+{
+    switch (peek(parser, *str))
+    {
+        case '{':
+            return parse_open(parser, str, JSON_OBJECT);
+        case '[':
+            return parse_open(parser, str, JSON_ARRAY);
+        case '"':
+            return parse_string(parser, str);
+        case '-':
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            return parse_number(parser, str);
+        case 't':
+            return parse_true(parser, str);
+        case 'f':
+            return parse_false(parser, str);
+        case 'n':
+            return parse_null(parser, str);
+        default:
             return NULL;
-        }
+    }
+}
 
-        json_t *child = parse(str, depth + 1);
+/**
+ * Parses a value without recursion: objects and arrays are pushed to the open
+ * stack and their members are parsed in the same loop, an iterable is attached
+ * to its parent once closed
+ */
+static json_t *parse(parser_t *parser, const char **str)
+{
+    size_t base = parser->size;
+    json_t *node;
 
-        if (!child || !append(parent, child))
+    for (;;)
+    {
+        if ((node = parse_value(parser, str)) == NULL)
         {
-            json_delete(parent);
-            json_delete(child);
-            free(key);
-            return NULL;
+            goto error;
         }
-        child->key = key;
-        if (**str == ',')
+        if ((node->type == JSON_OBJECT) || (node->type == JSON_ARRAY))
         {
-            *str = skip_spaces(++*str);
-            trailing_comma = 1;
+            node = NULL;
         }
-        else
+        else if (parser->depth == 0)
+        {
+            return node;
+        }
+
+        int trailing_comma = 0;
+
+        for (;;)
         {
-            trailing_comma = 0;
+            if (node != NULL)
+            {
+                // A value completed inside the iterable on top of the stack
+                if (!push(parser, node))
+                {
+                    delete_node(parser, node);
+                    goto error;
+                }
+                node = NULL;
+                if (peek(parser, *str) == ',')
+                {
+                    *str = skip_spaces(parser, ++*str);
+                    trailing_comma = 1;
+                }
+                else
+                {
+                    trailing_comma = 0;
+                }
+            }
+
+            json_t *parent = parser->open[parser->depth - 1].node;
+            size_t first = parser->open[parser->depth - 1].base;
+
+            if (peek(parser, *str) != (parent->type == JSON_OBJECT ? '}' : ']'))
+            {
+                if (((parser->size > first) && (trailing_comma == 0)) ||
+                    (parser->depth > max_depth))
+                {
+                    goto error;
+                }
+                if ((parent->type == JSON_OBJECT) && !parse_key(parser, str))
+                {
+                    goto error;
+                }
+                break;
+            }
+            if ((trailing_comma != 0) || !pack(parser, parent, first))
+            {
+                goto error;
+            }
+            *str = skip_spaces(parser, ++*str);
+            if (--parser->depth == 0)
+            {
+                return parent;
+            }
+            node = parent;
         }
     }
-    if (trailing_comma != 0)
+error:
+    discard(parser, base);
+    while (parser->depth > 0)
     {
-        json_delete(parent);
-        return NULL;
+        delete_node(parser, parser->open[--parser->depth].node);
     }
-    *str = skip_spaces(++*str);
-    return parent;
+    return NULL;
 }
 
-static json_t *parse_array(const char **str, unsigned short depth)
+static json_t *parse_document(parser_t *parser, const char *str, size_t length,
+    json_error_t *error)
 {
-    json_t *parent = new_node(JSON_ARRAY);
+    clear_error(error);
 
-    if (parent == NULL)
+    if (str == NULL)
     {
         return NULL;
     }
 
-    *str = skip_spaces(++*str);
+    parser->end = str + length;
+    if (parser->source == NULL)
+    {
+        parser->keys = json_get_keys();
+    }
 
-    int trailing_comma = 0;
+    const char *end = skip_spaces(parser, str);
+    json_t *node = parse(parser, &end);
 
-    while (**str != ']')
+    free(parser->stack);
+    free(parser->open);
+    if ((node == NULL) || (end != parser->end))
     {
-        if (((parent->size > 0) && (trailing_comma == 0)) || (depth >= max_depth))
-        {
-            json_delete(parent);
-            return NULL;
-        }
+        set_error(error, str, end);
+        delete_node(parser, node);
+        return NULL;
+    }
+    return node;
+}
+
+json_t *json_parse(const char *str, json_error_t *error)
+{
+    parser_t parser = { 0 };
+
+    return parse_document(&parser, str, str ? strlen(str) : 0, error);
+}
+
+/**
+ * Parses the first 'length' bytes of 'str', the text does not need to be
+ * terminated (slices of larger buffers can be parsed without copying them)
+ */
+json_t *json_parse_n(const char *str, size_t length, json_error_t *error)
+{
+    parser_t parser = { 0 };
+
+    return parse_document(&parser, str, length, error);
+}
+
+/**
+ * Restores the closing quotes of a failed in-situ parse, the text is a string
+ * so any '\0' before its end was written by insitu_string
+ */
+static void restore_quotes(char *str, size_t length)
+{
+    for (char *end = str + length; (str = memchr(str, '\0', (size_t)(end - str))); str++)
+    {
+        *str = '"';
+    }
+}
+
+/* Leaves an in-situ object unindexed when its keymap can not be created */
+static void create_keymap(json_t *node)
+{
+    if (!(json_keymap_of(node) = json_keymap_create(node, node->size, NULL)))
+    {
+        json_t **block = node->child - 1;
 
-        json_t *child = parse(str, depth + 1);
+        memmove(block, node->child, sizeof(*block) * node->size);
+        node->child = block;
+        node->packed = (unsigned char)(node->packed & ~JSON_INDEXED);
+    }
+}
 
-        if (!child || !append(parent, child))
+/**
+ * Parses modifying the passed string: keys and strings are decoded in place and
+ * nodes point to them, the document takes ownership of 'str' on success (it is
+ * released along with the root node). 'str' must be allocated with malloc and
+ * nodes of the document can not outlive the root.
+ * On failure the contents of 'str' are left as they were.
+ */
+json_t *json_parse_insitu(char *str, json_error_t *error)
+{
+    parser_t parser =
+    {
+        .source = str,
+        .borrowed = JSON_BORROWED_KEY | JSON_BORROWED_STRING
+    };
+    size_t length = str ? strlen(str) : 0;
+    json_t *node = parse_document(&parser, str, length, error);
+    struct json_document *document = NULL;
+
+    if (node != NULL)
+    {
+        // The root is moved before decoding (nothing can fail once 'str' is decoded),
+        // its entry in the list of refills is replaced by NULL
+        for (size_t i = 0; i < parser.refills; i++)
         {
-            json_delete(parent);
-            json_delete(child);
-            return NULL;
+            if (parser.refill[i] == node)
+            {
+                parser.refill[i] = NULL;
+            }
         }
-        if (**str == ',')
+        if ((document = realloc(node, sizeof *document)) == NULL)
         {
-            *str = skip_spaces(++*str);
-            trailing_comma = 1;
+            json_delete(node);
         }
-        else
+    }
+    if (document != NULL)
+    {
+        document->source = str;
+        document->node.packed |= JSON_DOCUMENT;
+        node = &document->node;
+        for (size_t i = 0; i < parser.pendings; i++)
+        {
+            char *text = parser.pending[i];
+
+            decode_string(text, text, text + strlen(text));
+        }
+        for (size_t i = 0; i < parser.refills; i++)
+        {
+            create_keymap(parser.refill[i] ? parser.refill[i] : node);
+        }
+        // Members are linked to the address of the root
+        if (node->packed & JSON_INDEXED)
         {
-            trailing_comma = 0;
+            json_keymap_reset(node);
         }
     }
-    if (trailing_comma != 0)
+    else if (str != NULL)
     {
-        json_delete(parent);
-        return NULL;
+        restore_quotes(str, length);
+        node = NULL;
     }
-    *str = skip_spaces(++*str);
-    return parent;
+    free(parser.pending);
+    free(parser.refill);
+    return node;
 }
 
-static json_t *parse_string(const char **str)
+/**
+ * Parses into an arena, nodes, keys, strings and arrays of children are served
+ * from the arena and they are released all at once by arena_clear()
+ */
+json_t *json_parse_arena(const char *str, json_arena_t *arena, json_error_t *error)
 {
-    const char *end = scan_string(++*str);
-
-    if (*end != '"')
+    if (arena == NULL)
     {
-        *str = end;
+        clear_error(error);
         return NULL;
     }
 
-    char *string = new_string(*str, end);
+    parser_t parser = { .arena = arena, .borrowed = JSON_BORROWED };
 
-    if (string == NULL)
-    {
-        return NULL;
-    }
+    return parse_document(&parser, str, str ? strlen(str) : 0, error);
+}
 
-    json_t *node = new_node(JSON_STRING);
+/**
+ * Regular files are parsed directly from a read-only mapping (no copy of the
+ * file is made), other files (pipes, devices) are read into memory
+ */
+json_t *json_parse_file(const char *path, json_error_t *error)
+{
+    size_t length;
+    const char *map = path ? file_map(path, &length) : NULL;
 
-    if (node == NULL)
+    if (map != NULL)
     {
-        free(string);
-        return NULL;
+        json_t *node = json_parse_n(map, length, error);
+
+        file_unmap(map, length);
+        return node;
     }
-    node->string = string;
-    *str = skip_spaces(end + 1);
+
+    char *str = path ? file_read(path) : NULL;
+    json_t *node = json_parse(str, error);
+
+    free(str);
     return node;
 }
 
-static json_t *parse_number(const char **str)
+/**
+ * Incremental parser: the document is received in chunks of any size (split at
+ * any point) and the tree is built as the tokens are completed, the result is
+ * the same tree built by json_parse
+ */
+struct json_parser
+{
+    json_stream_t *stream;
+    parser_t parser;
+    // Key of the next member
+    char *key;
+    json_t *root;
+    enum json_token state;
+};
+
+json_parser_t *json_parser_create(void)
 {
-    char *end;
-    double number = strtod(*str, &end);
+    json_parser_t *context = calloc(1, sizeof *context);
 
-    if (errno == ERANGE)
+    if (context == NULL)
     {
-        errno = 0;
         return NULL;
     }
-    if (isnan(number) || isinf(number))
+    if (!(context->stream = json_stream_create()))
     {
+        free(context);
         return NULL;
     }
+    context->state = JSON_TOKEN_MORE;
+    return context;
+}
 
-    json_t *node = new_node(JSON_REAL);
-
+/* Attaches a completed value to the iterable being parsed (or sets the root) */
+static int add_value(json_parser_t *context, json_t *node)
+{
     if (node == NULL)
     {
-        return NULL;
+        return 0;
     }
-    node->number = number;
-    // Differs from the standard, which only considers 'number' as a numeric
-    // type. Here, we classify nodes as either 'real' or 'integer'.
-    // Safe integers are numbers within the range of -2^52 to +2^52 (inclusive)
-    if ((*str + strspn(*str, "-0123456789") >= end) && IS_SAFE_INTEGER(number))
+    node->key = context->key;
+    context->key = NULL;
+    if (context->parser.depth == 0)
     {
-        node->type = JSON_INTEGER;
+        context->root = node;
+        return 1;
     }
-    *str = skip_spaces(end);
-    return node;
+    if (!push(&context->parser, node))
+    {
+        json_delete(node);
+        return 0;
+    }
+    return 1;
 }
 
-static json_t *parse_true(const char **str)
+static int open_value(json_parser_t *context, unsigned char type)
 {
-    if (strncmp(*str, "true", 4))
+    json_t *node = new_node(&context->parser, type, NULL, NULL);
+
+    if (node == NULL)
     {
-        return NULL;
+        return 0;
+    }
+    if (!open_node(&context->parser, node))
+    {
+        json_delete(node);
+        return 0;
     }
-    *str = skip_spaces(*str + 4);
-    return new_node(JSON_TRUE);
+    node->key = context->key;
+    context->key = NULL;
+    return 1;
 }
 
-static json_t *parse_false(const char **str)
+static int close_value(json_parser_t *context)
 {
-    if (strncmp(*str, "false", 5))
+    parser_t *parser = &context->parser;
+
+    parser->depth--;
+
+    json_t *node = parser->open[parser->depth].node;
+
+    if (!pack(parser, node, parser->open[parser->depth].base))
     {
-        return NULL;
+        json_delete(node);
+        return 0;
     }
-    *str = skip_spaces(*str + 5);
-    return new_node(JSON_FALSE);
+    // add_value takes the key of the node from the context
+    context->key = node->key;
+    return add_value(context, node);
 }
 
-static json_t *parse_null(const char **str)
+static char *new_text(const json_stream_t *stream)
 {
-    if (strncmp(*str, "null", 4))
+    size_t length = json_stream_length(stream);
+    char *text = malloc(length + 1);
+
+    if (text != NULL)
     {
-        return NULL;
+        memcpy(text, json_stream_text(stream), length + 1);
     }
-    *str = skip_spaces(*str + 4);
-    return new_node(JSON_NULL);
+    return text;
 }
 
-static json_t *parse(const char **str, unsigned short depth)
+static json_t *new_scalar(json_parser_t *context, enum json_token token)
 {
-    switch (**str)
+    unsigned char type = JSON_NULL;
+
+    switch (token)
     {
-        case '{':
-            return parse_object(str, depth);
-        case '[':
-            return parse_array(str, depth);
-        case '"':
-            return parse_string(str);
-        case '-':
-        case '0': case '1': case '2': case '3': case '4':
-        case '5': case '6': case '7': case '8': case '9':
-            return parse_number(str);
-        case 't':
-            return parse_true(str);
-        case 'f':
-            return parse_false(str);
-        case 'n':
-            return parse_null(str);
+        case JSON_TOKEN_STRING:
+            type = JSON_STRING;
+            break;
+        case JSON_TOKEN_INTEGER:
+            type = JSON_INTEGER;
+            break;
+        case JSON_TOKEN_REAL:
+            type = JSON_REAL;
+            break;
+        case JSON_TOKEN_TRUE:
+            type = JSON_TRUE;
+            break;
+        case JSON_TOKEN_FALSE:
+            type = JSON_FALSE;
+            break;
         default:
+            break;
+    }
+
+    json_t *node = new_node(&context->parser, type, NULL, NULL);
+
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    if (type == JSON_STRING)
+    {
+        if (!(node->string = new_text(context->stream)))
+        {
+            free(node);
             return NULL;
+        }
+    }
+    else if ((type == JSON_INTEGER) || (type == JSON_REAL))
+    {
+        node->number = json_stream_number(context->stream);
     }
+    return node;
 }
 
-json_t *json_parse(const char *str, json_error_t *error)
+/* Consumes the available tokens, returns JSON_TOKEN_MORE, END or ERROR */
+static enum json_token parse_tokens(json_parser_t *context)
 {
-    clear_error(error);
-
-    if (str == NULL)
+    for (;;)
     {
-        return NULL;
+        enum json_token token = json_stream_next(context->stream);
+        int done = 1;
+
+        switch (token)
+        {
+            case JSON_TOKEN_MORE:
+            case JSON_TOKEN_END:
+            case JSON_TOKEN_ERROR:
+                return token;
+            case JSON_TOKEN_OBJECT:
+                done = open_value(context, JSON_OBJECT);
+                break;
+            case JSON_TOKEN_ARRAY:
+                done = open_value(context, JSON_ARRAY);
+                break;
+            case JSON_TOKEN_OBJECT_END:
+            case JSON_TOKEN_ARRAY_END:
+                done = close_value(context);
+                break;
+            case JSON_TOKEN_KEY:
+                done = (context->key = new_text(context->stream)) != NULL;
+                break;
+            default:
+                done = add_value(context, new_scalar(context, token));
+                break;
+        }
+        if (!done)
+        {
+            return JSON_TOKEN_ERROR;
+        }
     }
+}
 
-    const char *end = skip_spaces(str);
-    json_t *node = parse(&end, 0);
+/**
+ * Parses the next chunk of the document, returns 0 on syntax or memory errors
+ * (see json_parser_finish to retrieve the position of the error)
+ */
+int json_parser_feed(json_parser_t *context, const char *chunk, size_t length)
+{
+    if ((context == NULL) || (context->state != JSON_TOKEN_MORE))
+    {
+        return 0;
+    }
+    if (!json_stream_feed(context->stream, chunk, length))
+    {
+        context->state = JSON_TOKEN_ERROR;
+        return 0;
+    }
+    context->state = parse_tokens(context);
+    return context->state != JSON_TOKEN_ERROR;
+}
 
-    if ((node == NULL) || (*end != '\0'))
+/**
+ * Signals the end of the input and returns the document (NULL on failure)
+ * The caller owns the document, the context must be released with
+ * json_parser_destroy
+ */
+json_t *json_parser_finish(json_parser_t *context, json_error_t *error)
+{
+    clear_error(error);
+    if (context == NULL)
     {
-        set_error(error, str, end);
-        json_delete(node);
         return NULL;
     }
+    if (context->state == JSON_TOKEN_MORE)
+    {
+        json_stream_finish(context->stream);
+        context->state = parse_tokens(context);
+    }
+    if (context->state != JSON_TOKEN_END)
+    {
+        // Line 0 (memory error) unless the stream failed on a syntax error
+        json_stream_error(context->stream, error);
+        return NULL;
+    }
+
+    json_t *node = context->root;
+
+    context->root = NULL;
     return node;
 }
 
-json_t *json_parse_file(const char *path, json_error_t *error)
+void json_parser_destroy(json_parser_t *context)
 {
-    char *str = path ? file_read(path) : NULL;
-    json_t *node = json_parse(str, error);
-
-    free(str);
-    return node;
+    if (context == NULL)
+    {
+        return;
+    }
+    discard(&context->parser, 0);
+    free(context->parser.stack);
+    for (size_t i = 0; i < context->parser.depth; i++)
+    {
+        json_delete(context->parser.open[i].node);
+    }
+    free(context->parser.open);
+    free(context->key);
+    json_delete(context->root);
+    json_stream_destroy(context->stream);
+    free(context);
 }
 
 void json_print_error(const json_error_t *error)
@@ -451,4 +1092,3 @@ void json_print_error(const json_error_t *error)
         fprintf(stderr, "json: Error at line %d, column %d\n", error->line, error->column);
     }
 }
-
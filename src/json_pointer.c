@@ -73,6 +73,13 @@ static int compare(const char *key, const char *path, const char *end)
 
 static const json_t *find_key(const json_t *node, const char *path, const char *end)
 {
+    // Escaped names ('~0' and '~1') are rare, those are matched by a linear scan
+    if ((node->packed & JSON_INDEXED) && !memchr(path, '~', (size_t)(end - path)))
+    {
+        unsigned index = json_keymap_find(node, path, (size_t)(end - path));
+
+        return index != JSON_NOT_FOUND ? node->child[index] : NULL;
+    }
     for (unsigned index = 0; index < node->size; index++)
     {
         if (compare(node->child[index]->key, path, end))
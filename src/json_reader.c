@@ -128,12 +128,12 @@ int json_is_null(const json_t *node)
 
 int json_is_root(const json_t *node)
 {
-    return node && !node->packed;
+    return node && !(node->packed & JSON_PACKED);
 }
 
 int json_is_child(const json_t *node)
 {
-    return node && node->packed;
+    return node && (node->packed & JSON_PACKED);
 }
 
 enum json_type json_type(const json_t *node)
@@ -189,9 +189,14 @@ unsigned json_index(const json_t *node, const char *key)
 {
     if ((node != NULL) && (node->type == JSON_OBJECT) && (key != NULL))
     {
+        if (node->packed & JSON_INDEXED)
+        {
+            return json_keymap_find(node, key, strlen(key));
+        }
         for (unsigned index = 0; index < node->size; index++)
         {
-            if (!strcmp(node->child[index]->key, key))
+            // Interned keys are compared by address first
+            if ((node->child[index]->key == key) || !strcmp(node->child[index]->key, key))
             {
                 return index;
             }
@@ -247,9 +252,15 @@ json_t *json_find(const json_t *node, const char *key)
     {
         return NULL;
     }
+    if (node->packed & JSON_INDEXED)
+    {
+        unsigned index = json_keymap_find(node, key, strlen(key));
+
+        return index != JSON_NOT_FOUND ? node->child[index] : NULL;
+    }
     for (unsigned index = 0; index < node->size; index++)
     {
-        if (strcmp(node->child[index]->key, key) == 0)
+        if ((node->child[index]->key == key) || !strcmp(node->child[index]->key, key))
         {
             return node->child[index];
         }
@@ -266,7 +277,7 @@ json_t *json_locate(const json_t *parent, const json_t *child)
     }
     for (unsigned index = 0; index < parent->size; index++)
     {
-        if (json_equal(parent->child[index], child))
+        if (json_equal(parent->child[index], child) > 0)
         {
             return parent->child[index];
         }
@@ -307,7 +318,7 @@ int json_is_unique(const json_t *parent, const json_t *child)
         {
             continue;
         }
-        if (json_equal(parent->child[i], child))
+        if (json_equal(parent->child[i], child) > 0)
         {
             return 0;
         }
@@ -315,6 +326,9 @@ int json_is_unique(const json_t *parent, const json_t *child)
     return 1;
 }
 
+// Smaller arrays are compared pairwise
+#define UNIQUE_HASHED_MIN 16
+
 /* Returns 1 if all nodes are unique, 0 otherwise */
 int json_unique_children(const json_t *node)
 {
@@ -322,11 +336,25 @@ int json_unique_children(const json_t *node)
     {
         return 0;
     }
+
+    struct json_hashset set;
+
+    if ((node->size >= UNIQUE_HASHED_MIN) && json_hashset_init(&set, node))
+    {
+        int unique = 1;
+
+        for (unsigned i = 0; unique && (i < node->size); i++)
+        {
+            unique = json_hashset_insert(&set, i) == JSON_NOT_FOUND;
+        }
+        json_hashset_free(&set);
+        return unique;
+    }
     for (unsigned i = 0; i < node->size; i++)
     {
         for (unsigned j = 0; j < i; j++)
         {
-            if (json_equal(node->child[i], node->child[j]))
+            if (json_equal(node->child[i], node->child[j]) > 0)
             {
                 return 0;
             }
@@ -354,31 +382,51 @@ static int equal(const json_t *a, const json_t *b)
     }
 }
 
-/* json_equal helper */
+/* Compares two members (same position), interned keys are compared by address first */
+static int equal_member(const json_t *a, const json_t *b)
+{
+    return equal(a, b) && ((a->key == b->key) || (a->key == NULL) || !strcmp(a->key, b->key));
+}
+
+/* json_equal helper, the subtrees are traversed on an explicit stack */
 static int equal_children(const json_t *a, const json_t *b)
 {
-    for (unsigned i = 0; i < a->size; i++)
+    struct json_stack stack = { 0 };
+    int rc = 1;
+
+    // The first frames are not allocated, this push can not fail
+    json_stack_push(&stack, a, b);
+    while (rc && (stack.size > 0))
     {
-        const json_t *c = a->child[i];
-        const json_t *d = b->child[i];
+        struct json_frame *frame = json_stack_top(&stack);
 
-        if (!equal(c, d))
+        if (frame->index == frame->node->size)
         {
-            return 0;
+            stack.size--;
+            continue;
         }
-        if ((c->key != NULL) && strcmp(c->key, d->key))
+
+        const json_t *c = frame->node->child[frame->index];
+        const json_t *d = frame->peer->child[frame->index];
+
+        frame->index++;
+        if (!equal_member(c, d))
         {
-            return 0;
+            rc = 0;
         }
-        if ((c->size > 0) && !equal_children(c, d))
+        else if ((c->size > 0) && !json_stack_push(&stack, c, d))
         {
-            return 0;
+            rc = -1;
         }
     }
-    return 1;
+    json_stack_free(&stack);
+    return rc;
 }
 
-/* Returns 1 if 'a' and 'b' and his children are equal, 0 otherwise */
+/**
+ * Returns 1 if 'a' and 'b' and his children are equal, 0 otherwise
+ * Returns -1 if the stack of deep levels can not be allocated
+ */
 int json_equal(const json_t *a, const json_t *b)
 {
     if ((a != NULL) && (b != NULL))
@@ -392,31 +440,40 @@ int json_equal(const json_t *a, const json_t *b)
     return 0;
 }
 
-/* json_walk recursive helper sending 'node' along with 'depth' and 'data' */
-static int walk(const json_t *node, unsigned short depth, json_walk_callback callback, void *data)
+/* json_walk helper sending 'node' along with 'depth' and 'data' */
+static int walk(const json_t *node, json_walk_callback callback, void *data)
 {
-    for (unsigned i = 0; i < node->size; i++)
+    struct json_stack stack = { 0 };
+    int rc = 1;
+
+    // The first frames are not allocated, this push can not fail
+    json_stack_push(&stack, node, NULL);
+    while ((rc > 0) && (stack.size > 0))
     {
-        int rc;
+        struct json_frame *frame = json_stack_top(&stack);
 
-        if ((rc = callback(node->child[i], depth, data)) <= 0)
+        if (frame->index == frame->node->size)
         {
-            return rc;
+            stack.size--;
+            continue;
         }
-        if (node->child[i]->size > 0)
+
+        const json_t *child = frame->node->child[frame->index++];
+
+        if (((rc = callback(child, stack.size - 1, data)) > 0) && (child->size > 0) &&
+            !json_stack_push(&stack, child, NULL))
         {
-            if ((rc = walk(node->child[i], depth + 1, callback, data)) <= 0)
-            {
-                return rc;
-            }
+            rc = -1;
         }
     }
-    return 1;
+    json_stack_free(&stack);
+    return rc;
 }
 
 /**
  * Traverses a json tree sendng all nodes to a callback
  * Uses a temporary parent in order to avoid checking the parent in helper
+ * Returns -1 if the stack of deep levels can not be allocated
  */
 int json_walk(const json_t *node, json_walk_callback callback, void *data)
 {
@@ -429,7 +486,7 @@ int json_walk(const json_t *node, json_walk_callback callback, void *data)
             .type = node->key ? JSON_OBJECT : JSON_ARRAY
         };
 
-        return walk(&parent, 0, callback, data);
+        return walk(&parent, callback, data);
     }
     return 0;
 }
@@ -4,11 +4,17 @@
  *  \copyright GNU Public License.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdint.h>
 #include <math.h>
+#include "clib_check.h"
 #include "clib_string.h"
 #include "clib_match.h"
 #include "clib_regex.h"
@@ -19,6 +25,10 @@
 
 #define MAX_PATHS 32
 #define MAX_REFS 128
+// Smaller arrays and objects are not worth a thread
+#define PARALLEL_MIN 256
+// Smaller enums are searched linearly
+#define ENUM_HASHED_MIN 16
 
 enum { NOT_ABORTABLE, ABORTABLE };
 
@@ -29,6 +39,45 @@ struct tracker
     unsigned refs;
 };
 
+typedef struct program program_t;
+
+/* A keyword of a compiled rule, NULL members fall back to the interpreter */
+struct step
+{
+    int test;
+    // 'type' as a mask
+    unsigned mask;
+    // 'pattern' and patternProperties keys
+    pattern_t *pattern, **patterns;
+    // Subschema (or target of '$ref') and subschemas of the members
+    const program_t *program, **programs;
+    // 'enum' values
+    struct json_hashset *values;
+};
+
+/* A rule compiled by json_schema_compile, one step per member */
+struct program
+{
+    const json_t *rule;
+    // Siblings read by additionalProperties and additionalItems
+    const json_t *properties, *patterns, *items;
+    pattern_t * const *regexes;
+    struct step steps[];
+};
+
+struct json_schema
+{
+    const json_t *rule;
+    const map_t *map;
+    const program_t *root;
+    // Programs in order of creation
+    program_t **list;
+    size_t size, room;
+    // Programs indexed by rule (open addressing)
+    program_t **hash;
+    size_t slots;
+};
+
 typedef struct
 {
     // Pointers to roots
@@ -40,9 +89,15 @@ typedef struct
     void *data;
     // Paths and reference counters
     struct tracker * const active;
+    // Parallel validation (see validate_children), the child being validated
+    struct pool *pool;
+    unsigned turn;
+    // Already in a worker, children are validated in sequence
+    int sequential;
 } schema_t;
 
 static enum json_warning_mode warning_mode = JSON_WARNINGS_ON;
+static unsigned validate_threads = 1;
 
 void json_set_warning_mode(enum json_warning_mode mode)
 {
@@ -54,10 +109,29 @@ enum json_warning_mode json_get_warning_mode(void)
     return warning_mode;
 }
 
+/* Sets the number of threads validating large arrays and objects (0 = one per core) */
+void json_set_validate_threads(unsigned threads)
+{
+    validate_threads = threads;
+}
+
+unsigned json_get_validate_threads(void)
+{
+    return validate_threads;
+}
+
+static int wait_turn(struct pool *, unsigned);
+
 /* Notifies an event to the user-defined callback */
 static int notify_event(const schema_t *schema, const json_t *rule, const json_t *node,
     enum json_event_type type)
 {
+    // Validation was aborted by a previous child, stop
+    if ((schema->pool != NULL) && !wait_turn(schema->pool, schema->turn))
+    {
+        return 1;
+    }
+
     const json_pointer_t pointer =
     {
         .root = schema->node,
@@ -124,7 +198,8 @@ char *json_write_event(buffer_t *buffer, const json_event_t *event)
     return buffer_put(buffer, '\n');
 }
 
-static int validate(const schema_t *, const json_t *, const json_t *, int);
+static int validate(const schema_t *, const json_t *, const program_t *,
+    const json_t *, int);
 
 #define hash(key) hash_str((const unsigned char *)(key))
 static unsigned long hash_str(const unsigned char *key)
@@ -275,6 +350,16 @@ static int get_test(const json_t *rule)
     }
 }
 
+static const program_t *step_program(const struct step *step)
+{
+    return step ? step->program : NULL;
+}
+
+static const program_t *sub_program(const struct step *step, unsigned index)
+{
+    return step && step->programs ? step->programs[index] : NULL;
+}
+
 static int test_abort(const schema_t *schema, const json_t *rule, const json_t *node,
     int abortable)
 {
@@ -299,10 +384,10 @@ static int test_false(const schema_t *schema, const json_t *rule, const json_t *
     return result;
 }
 
-static int test_valid(const schema_t *schema, const json_t *rule, const json_t *node,
-    int abortable)
+static int test_valid(const schema_t *schema, const json_t *rule,
+    const program_t *program, const json_t *node, int abortable)
 {
-    int result = validate(schema, rule, node, abortable);
+    int result = validate(schema, rule, program, node, abortable);
 
     if (!abortable && (result == SCHEMA_INVALID))
     {
@@ -311,15 +396,15 @@ static int test_valid(const schema_t *schema, const json_t *rule, const json_t *
     return result;
 }
 
-static int test_child(const schema_t *schema, const json_t *rule, const json_t *parent,
-    unsigned child, int abortable)
+static int test_child(const schema_t *schema, const json_t *rule,
+    const program_t *program, const json_t *parent, unsigned child, int abortable)
 {
     if (schema->active->paths++ < MAX_PATHS)
     {
         schema->active->path[schema->active->paths - 1] = child;
     }
 
-    int result = validate(schema, rule, parent->child[child], abortable);
+    int result = validate(schema, rule, program, parent->child[child], abortable);
 
     if (!abortable && (result == SCHEMA_INVALID))
     {
@@ -329,8 +414,222 @@ static int test_child(const schema_t *schema, const json_t *rule, const json_t *
     return result;
 }
 
-static int test_properties(const schema_t *schema, const json_t *rule, const json_t *node,
+/*
+--------------------------------------------------------
+Parallel validation
+--------------------------------------------------------
+When enabled with json_set_validate_threads, the
+children of large arrays (items) and objects
+(additionalProperties) are validated by a pool of
+threads, each one with its own tracker
+
+The callback is called as in a sequential validation:
+in the same order, never concurrently, and the events
+of a child are not delivered until the previous
+children are done (a child waits for its turn)
+
+A child aborting the validation (a callback returning
+non 0 or an error in the schema) stops the children
+after it when its turn comes
+--------------------------------------------------------
+*/
+
+enum { SCHEMA_PENDING = ~SCHEMA_VALID };
+
+struct pool
+{
+    const schema_t *schema;
+    const json_t *rule, *node;
+    const program_t *program;
+    // Children to validate (NULL = every child of node)
+    const unsigned *index;
+    unsigned size;
+    // Next child to validate and number of leading children done
+    unsigned next, done;
+    int *result;
+    int aborted;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+/* Waits until the previous children are done, returns 0 if aborted */
+static int wait_turn(struct pool *pool, unsigned turn)
+{
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->aborted && (pool->done != turn))
+    {
+        pthread_cond_wait(&pool->cond, &pool->mutex);
+    }
+
+    int rc = !pool->aborted;
+
+    pthread_mutex_unlock(&pool->mutex);
+    return rc;
+}
+
+static int is_result(int test)
+{
+    return (test == SCHEMA_VALID) || (test == SCHEMA_INVALID);
+}
+
+static void *validate_worker(void *data)
+{
+    struct pool *pool = data;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->aborted && (pool->next < pool->size))
+    {
+        unsigned turn = pool->next++;
+
+        pthread_mutex_unlock(&pool->mutex);
+
+        struct tracker active = *pool->schema->active;
+        const schema_t schema =
+        {
+            .rule = pool->schema->rule, .node = pool->schema->node,
+            .map = pool->schema->map,
+            .callback = pool->schema->callback, .data = pool->schema->data,
+            .active = &active,
+            .pool = pool, .turn = turn,
+            .sequential = 1
+        };
+        int result = test_child(&schema, pool->rule, pool->program, pool->node,
+            pool->index ? pool->index[turn] : turn, ABORTABLE);
+
+        pthread_mutex_lock(&pool->mutex);
+        pool->result[turn] = result;
+        // Children are done out of order, the turn moves over the leading ones
+        while (pool->done < pool->size)
+        {
+            int test = pool->result[pool->done];
+
+            if (test == SCHEMA_PENDING)
+            {
+                break;
+            }
+            if (!is_result(test))
+            {
+                pool->aborted = 1;
+                break;
+            }
+            pool->done++;
+        }
+        pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+/* Threads for 'size' tasks ('threads' = 0 is one per online core) */
+static size_t pool_threads(size_t threads, size_t size)
+{
+    if (threads == 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+        threads = cores > 1 ? (size_t)cores : 1;
+    }
+    return threads < size ? threads : size;
+}
+
+/* Validates the children in parallel, returns SCHEMA_WARNING if not possible */
+static int validate_pool(struct pool *pool)
+{
+    size_t threads = pool_threads(validate_threads, pool->size);
+
+    if (threads < 2)
+    {
+        return SCHEMA_WARNING;
+    }
+
+    pthread_t *thread = malloc(sizeof(*thread) * (threads - 1));
+
+    if (!(pool->result = malloc(sizeof(*pool->result) * pool->size)) || (thread == NULL))
+    {
+        free(pool->result);
+        free(thread);
+        return SCHEMA_WARNING;
+    }
+    for (unsigned i = 0; i < pool->size; i++)
+    {
+        pool->result[i] = SCHEMA_PENDING;
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    size_t started = 0;
+
+    while ((started < threads - 1) &&
+           (pthread_create(&thread[started], NULL, validate_worker, pool) == 0))
+    {
+        started++;
+    }
+    // The calling thread is one of the workers
+    validate_worker(pool);
+    for (size_t i = 0; i < started; i++)
+    {
+        pthread_join(thread[i], NULL);
+    }
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->mutex);
+    free(thread);
+
+    int result = SCHEMA_VALID;
+
+    for (unsigned i = 0; i < pool->size; i++)
+    {
+        if (!is_result(pool->result[i]))
+        {
+            result = pool->result[i];
+            break;
+        }
+        result &= pool->result[i];
+    }
+    free(pool->result);
+    return is_result(result) ? ~result : result;
+}
+
+/**
+ * Validates children of 'node' against the same rule ('index' = the children
+ * to validate or NULL for all), in parallel if the node is large enough
+ */
+static int validate_children(const schema_t *schema, const json_t *rule,
+    const program_t *program, const json_t *node, const unsigned *index, unsigned size,
     int abortable)
+{
+    // Not nested, and results and events don't depend on stopping at the first failure
+    if (abortable && !schema->sequential && (size >= PARALLEL_MIN))
+    {
+        struct pool pool =
+        {
+            .schema = schema, .rule = rule, .node = node, .program = program,
+            .index = index, .size = size
+        };
+        int result = validate_pool(&pool);
+
+        if (result != SCHEMA_WARNING)
+        {
+            return result;
+        }
+    }
+
+    int result = SCHEMA_VALID;
+
+    for (unsigned i = 0; i < size; i++)
+    {
+        int test = test_child(schema, rule, program, node, index ? index[i] : i, abortable);
+
+        if (!is_result(test))
+        {
+            return test;
+        }
+        result &= test;
+    }
+    return ~result;
+}
+
+static int test_properties(const schema_t *schema, const json_t *rule, const json_t *node,
+    int abortable, const struct step *step)
 {
     if (rule->type != JSON_OBJECT)
     {
@@ -365,7 +664,8 @@ static int test_properties(const schema_t *schema, const json_t *rule, const jso
 
         if (rule->child[i]->type == JSON_OBJECT)
         {
-            test = test_child(schema, rule->child[i], node, index, abortable);
+            test = test_child(schema, rule->child[i], sub_program(step, i), node, index,
+                abortable);
         }
         else
         {
@@ -381,7 +681,7 @@ static int test_properties(const schema_t *schema, const json_t *rule, const jso
 }
 
 static int test_pattern_properties(const schema_t *schema, const json_t *rule,
-    const json_t *node, int abortable)
+    const json_t *node, int abortable, const struct step *step)
 {
     if (rule->type != JSON_OBJECT)
     {
@@ -406,7 +706,8 @@ static int test_pattern_properties(const schema_t *schema, const json_t *rule,
         }
         for (unsigned j = 0; j < node->size; j++)
         {
-            if (!test_regex(node->child[j]->key, rule->child[i]->key))
+            if (step ? !pattern_test(step->patterns[i], node->child[j]->key)
+                     : !test_regex(node->child[j]->key, rule->child[i]->key))
             {
                 continue;
             }
@@ -427,7 +728,8 @@ static int test_pattern_properties(const schema_t *schema, const json_t *rule,
             }
             else
             {
-                test = test_child(schema, rule->child[i], node, j, abortable);
+                test = test_child(schema, rule->child[i], sub_program(step, i), node, j,
+                    abortable);
             }
             if ((test != SCHEMA_VALID) && (test != SCHEMA_INVALID))
             {
@@ -439,8 +741,31 @@ static int test_pattern_properties(const schema_t *schema, const json_t *rule,
     return ~result;
 }
 
+/* Members matched neither by properties nor by patternProperties */
+static int is_additional(const program_t *program, const json_t *properties,
+    const json_t *patterns, const char *key)
+{
+    if (json_find(properties, key))
+    {
+        return 0;
+    }
+
+    unsigned size = json_properties(patterns);
+
+    for (unsigned j = 0; j < size; j++)
+    {
+        if (program ? pattern_test(program->regexes[j], key)
+                    : test_regex(key, patterns->child[j]->key))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 static int test_additional_properties(const schema_t *schema, const json_t *parent,
-    const json_t *rule, const json_t *node, int abortable)
+    const program_t *program, const json_t *rule, const json_t *node, int abortable,
+    const struct step *step)
 {
     switch (rule->type)
     {
@@ -457,30 +782,49 @@ static int test_additional_properties(const schema_t *schema, const json_t *pare
         return SCHEMA_VALID;
     }
 
-    const json_t *properties = json_find(parent, "properties");
-    const json_t *patterns = json_find(parent, "patternProperties");
-    unsigned patterns_size = json_properties(patterns);
+    const json_t *properties = program ? program->properties : json_find(parent, "properties");
+    const json_t *patterns = program ? program->patterns : json_find(parent, "patternProperties");
+
+    // Large objects are validated by validate_children
+    if ((rule->type == JSON_OBJECT) && abortable && !schema->sequential &&
+        (node->size >= PARALLEL_MIN))
+    {
+        unsigned *index = malloc(sizeof(*index) * node->size);
+
+        if (index != NULL)
+        {
+            unsigned size = 0;
+
+            for (unsigned i = 0; i < node->size; i++)
+            {
+                if (is_additional(program, properties, patterns, node->child[i]->key))
+                {
+                    index[size++] = i;
+                }
+            }
+
+            int result = validate_children(schema, rule, step_program(step), node, index,
+                size, abortable);
+
+            free(index);
+            return result;
+        }
+    }
+
     int result = SCHEMA_VALID;
 
     for (unsigned i = 0; i < node->size; i++)
     {
-        if (json_find(properties, node->child[i]->key))
+        if (!is_additional(program, properties, patterns, node->child[i]->key))
         {
             continue;
         }
-        for (unsigned j = 0; j < patterns_size; j++)
-        {
-            if (test_regex(node->child[i]->key, patterns->child[j]->key))
-            {
-                goto jump;
-            }
-        }
 
         int test;
 
         if (rule->type == JSON_OBJECT)
         {
-            test = test_child(schema, rule, node, i, abortable);
+            test = test_child(schema, rule, step_program(step), node, i, abortable);
         }
         else
         {
@@ -491,13 +835,12 @@ static int test_additional_properties(const schema_t *schema, const json_t *pare
             return test;
         }
         result &= test;
-        jump:;
     }
     return ~result;
 }
 
 static int test_property_names(const schema_t *schema, const json_t *rule,
-    const json_t *node, int abortable)
+    const json_t *node, int abortable, const struct step *step)
 {
     switch (rule->type)
     {
@@ -526,7 +869,7 @@ static int test_property_names(const schema_t *schema, const json_t *rule,
             .type = JSON_STRING
         };
 
-        int test = test_valid(schema, rule, &name, abortable);
+        int test = test_valid(schema, rule, step_program(step), &name, abortable);
 
         if ((test != SCHEMA_VALID) && (test != SCHEMA_INVALID))
         {
@@ -581,7 +924,7 @@ static int test_required(const schema_t *schema, const json_t *rule, const json_
 }
 
 static int test_dependencies(const schema_t *schema, const json_t *rule, const json_t *node,
-    int abortable)
+    int abortable, const struct step *step)
 {
     if (rule->type != JSON_OBJECT)
     {
@@ -606,7 +949,7 @@ static int test_dependencies(const schema_t *schema, const json_t *rule, const j
         }
         if (rule->child[i]->type == JSON_OBJECT)
         {
-            int test = validate(schema, rule->child[i], node, abortable);
+            int test = validate(schema, rule->child[i], sub_program(step, i), node, abortable);
 
             if ((test != SCHEMA_VALID) && (test != SCHEMA_INVALID))
             {
@@ -677,7 +1020,7 @@ static int test_max_properties(const json_t *rule, const json_t *node)
 }
 
 static int test_items(const schema_t *schema, const json_t *rule, const json_t *node,
-    int abortable)
+    int abortable, const struct step *step)
 {
     switch (rule->type)
     {
@@ -700,16 +1043,8 @@ static int test_items(const schema_t *schema, const json_t *rule, const json_t *
 
     if (rule->type == JSON_OBJECT)
     {
-        for (unsigned i = 0; i < node->size; i++)
-        {
-            int test = test_child(schema, rule, node, i, abortable);
-
-            if ((test != SCHEMA_VALID) && (test != SCHEMA_INVALID))
-            {
-                return test;
-            }
-            result &= test;
-        }
+        return validate_children(schema, rule, step_program(step), node, NULL, node->size,
+            abortable);
     }
     else
     {
@@ -719,7 +1054,8 @@ static int test_items(const schema_t *schema, const json_t *rule, const json_t *
 
             if (rule->child[i]->type == JSON_OBJECT)
             {
-                test = test_child(schema, rule->child[i], node, i, abortable);
+                test = test_child(schema, rule->child[i], sub_program(step, i), node, i,
+                    abortable);
             }
             else if (rule->child[i]->type == JSON_FALSE)
             {
@@ -740,7 +1076,8 @@ static int test_items(const schema_t *schema, const json_t *rule, const json_t *
 }
 
 static int test_additional_items(const schema_t *schema, const json_t *parent,
-    const json_t *rule, const json_t *node, int abortable)
+    const program_t *program, const json_t *rule, const json_t *node, int abortable,
+    const struct step *step)
 {
     switch (rule->type)
     {
@@ -757,7 +1094,7 @@ static int test_additional_items(const schema_t *schema, const json_t *parent,
         return SCHEMA_VALID;
     }
 
-    const json_t *items = json_find(parent, "items");
+    const json_t *items = program ? program->items : json_find(parent, "items");
 
     if (json_items(items) == 0)
     {
@@ -772,7 +1109,7 @@ static int test_additional_items(const schema_t *schema, const json_t *parent,
 
     for (unsigned i = items->size; i < node->size; i++)
     {
-        int test = test_child(schema, rule, node, i, abortable);
+        int test = test_child(schema, rule, step_program(step), node, i, abortable);
 
         if ((test != SCHEMA_VALID) && (test != SCHEMA_INVALID))
         {
@@ -796,7 +1133,8 @@ static int test_unique_items(const json_t *rule, const json_t *node)
     return json_unique_children(node);
 }
 
-static int test_contains(const schema_t *schema, const json_t *rule, const json_t *node)
+static int test_contains(const schema_t *schema, const json_t *rule, const json_t *node,
+    const struct step *step)
 {
     switch (rule->type)
     {
@@ -815,7 +1153,7 @@ static int test_contains(const schema_t *schema, const json_t *rule, const json_
     }
     for (unsigned i = 0; i < node->size; i++)
     {
-        int test = validate(schema, rule, node->child[i], NOT_ABORTABLE);
+        int test = validate(schema, rule, step_program(step), node->child[i], NOT_ABORTABLE);
 
         if (test == SCHEMA_ABORT)
         {
@@ -868,7 +1206,7 @@ static int test_format(const json_t *rule, const json_t *node)
     return test_match(node->string, rule->string);
 }
 
-static int test_pattern(const json_t *rule, const json_t *node)
+static int test_pattern(const json_t *rule, const json_t *node, const struct step *step)
 {
     if (rule->type != JSON_STRING)
     {
@@ -878,7 +1216,8 @@ static int test_pattern(const json_t *rule, const json_t *node)
     {
         return SCHEMA_VALID;
     }
-    return test_regex(node->string, rule->string);
+    return step ? pattern_test(step->pattern, node->string)
+                : test_regex(node->string, rule->string);
 }
 
 static int test_x_mask(const json_t *rule, const json_t *node)
@@ -987,15 +1326,19 @@ static int test_exclusive_maximum(const json_t *rule, const json_t *node)
 
 static int test_const(const json_t *rule, const json_t *node)
 {
-    return json_equal(rule, node);
+    return json_equal(rule, node) > 0;
 }
 
-static int test_enum(const json_t *rule, const json_t *node)
+static int test_enum(const json_t *rule, const json_t *node, const struct step *step)
 {
     if ((rule->type != JSON_ARRAY) || (rule->size == 0))
     {
         return SCHEMA_ERROR;
     }
+    if ((step != NULL) && (step->values != NULL))
+    {
+        return json_hashset_find(step->values, node) != JSON_NOT_FOUND;
+    }
     return json_locate(rule, node) != NULL;
 }
 
@@ -1018,29 +1361,33 @@ static unsigned add_type(const char *type, unsigned *mask)
     return 0;
 }
 
-static int test_type(const json_t *rule, const json_t *node)
+static unsigned type_mask(const json_t *rule, unsigned *mask)
 {
-    unsigned mask = 0;
-
     switch (rule->type)
     {
         case JSON_STRING:
-            if (!add_type(rule->string, &mask))
-            {
-                return SCHEMA_ERROR;
-            }
-            break;
+            return add_type(rule->string, mask);
         case JSON_ARRAY:
             for (unsigned i = 0; i < rule->size; i++)
             {
-                if (!add_type(json_text(rule->child[i]), &mask))
+                if (!add_type(json_text(rule->child[i]), mask))
                 {
-                    return SCHEMA_ERROR;
+                    return 0;
                 }
             }
-            break;
+            return 1;
         default:
-            return SCHEMA_ERROR;
+            return 0;
+    }
+}
+
+static int test_type(const json_t *rule, const json_t *node, const struct step *step)
+{
+    unsigned mask = step ? step->mask : 0;
+
+    if ((mask == 0) && !type_mask(rule, &mask))
+    {
+        return SCHEMA_ERROR;
     }
     return
         /* Reduce JSON_FALSE and JSON_NULL in order to match 'type' offsets */
@@ -1049,36 +1396,45 @@ static int test_type(const json_t *rule, const json_t *node)
         ((mask & JSON_REAL) && (node->type == JSON_INTEGER));
 }
 
-static int test_ref(const schema_t *schema, const json_t *rule, const json_t *node,
-    int abortable)
+static const json_t *resolve_ref(const json_t *root, const map_t *map, const char *ref)
 {
-    if (rule->type != JSON_STRING)
-    {
-        return SCHEMA_ERROR;
-    }
-
-    const char *ref = rule->string;
-
     if (ref[0] == '#')
     {
         if (ref[1] == '/')
         {
-            rule = json_pointer(schema->rule, ref + 1);
+            return json_pointer(root, ref + 1);
         }
-        else if (ref[1] == '\0')
+        if (ref[1] == '\0')
         {
-            rule = schema->rule;
+            return root;
         }
     }
-    else if (schema->map != NULL)
+    else if (map != NULL)
     {
         size_t length = strcspn(ref, "/");
 
-        rule = json_pointer(map_search_max(schema->map, ref, length), ref + length);
+        return json_pointer(map_search_max(map, ref, length), ref + length);
+    }
+    return NULL;
+}
+
+static int test_ref(const schema_t *schema, const json_t *rule, const json_t *node,
+    int abortable, const struct step *step)
+{
+    if (rule->type != JSON_STRING)
+    {
+        return SCHEMA_ERROR;
+    }
+
+    const program_t *program = step_program(step);
+
+    if (program != NULL)
+    {
+        rule = program->rule;
     }
     else
     {
-        rule = NULL;
+        rule = resolve_ref(schema->rule, schema->map, rule->string);
     }
     if ((rule == NULL) || (rule->type != JSON_OBJECT))
     {
@@ -1097,13 +1453,14 @@ static int test_ref(const schema_t *schema, const json_t *rule, const json_t *no
         return SCHEMA_ABORT;
     }
 
-    int result = validate(schema, rule, node, abortable);
+    int result = validate(schema, rule, program, node, abortable);
 
     schema->active->refs--;
     return ~result;
 }
 
-static int test_not(const schema_t *schema, const json_t *rule, const json_t *node)
+static int test_not(const schema_t *schema, const json_t *rule, const json_t *node,
+    const struct step *step)
 {
     switch (rule->type)
     {
@@ -1117,7 +1474,7 @@ static int test_not(const schema_t *schema, const json_t *rule, const json_t *no
             return SCHEMA_ERROR;
     }
 
-    int result = validate(schema, rule, node, NOT_ABORTABLE);
+    int result = validate(schema, rule, step_program(step), node, NOT_ABORTABLE);
 
     if ((result != SCHEMA_VALID) && (result != SCHEMA_INVALID))
     {
@@ -1126,7 +1483,8 @@ static int test_not(const schema_t *schema, const json_t *rule, const json_t *no
     return !result;
 }
 
-static int test_any_of(const schema_t *schema, const json_t *rule, const json_t *node)
+static int test_any_of(const schema_t *schema, const json_t *rule, const json_t *node,
+    const struct step *step)
 {
     if (rule->type != JSON_ARRAY)
     {
@@ -1139,7 +1497,8 @@ static int test_any_of(const schema_t *schema, const json_t *rule, const json_t
             return SCHEMA_ERROR;
         }
 
-        int test = validate(schema, rule->child[i], node, NOT_ABORTABLE);
+        int test = validate(schema, rule->child[i], sub_program(step, i), node,
+            NOT_ABORTABLE);
 
         if (test != SCHEMA_INVALID)
         {
@@ -1149,7 +1508,8 @@ static int test_any_of(const schema_t *schema, const json_t *rule, const json_t
     return SCHEMA_INVALID;
 }
 
-static int test_one_of(const schema_t *schema, const json_t *rule, const json_t *node)
+static int test_one_of(const schema_t *schema, const json_t *rule, const json_t *node,
+    const struct step *step)
 {
     if (rule->type != JSON_ARRAY)
     {
@@ -1165,7 +1525,8 @@ static int test_one_of(const schema_t *schema, const json_t *rule, const json_t
             return SCHEMA_ERROR;
         }
 
-        int test = validate(schema, rule->child[i], node, NOT_ABORTABLE);
+        int test = validate(schema, rule->child[i], sub_program(step, i), node,
+            NOT_ABORTABLE);
 
         if (test == SCHEMA_ABORT)
         {
@@ -1179,7 +1540,8 @@ static int test_one_of(const schema_t *schema, const json_t *rule, const json_t
     return count == 1;
 }
 
-static int test_all_of(const schema_t *schema, const json_t *rule, const json_t *node)
+static int test_all_of(const schema_t *schema, const json_t *rule, const json_t *node,
+    const struct step *step)
 {
     if (rule->type != JSON_ARRAY)
     {
@@ -1192,7 +1554,8 @@ static int test_all_of(const schema_t *schema, const json_t *rule, const json_t
             return SCHEMA_ERROR;
         }
 
-        int test = validate(schema, rule->child[i], node, NOT_ABORTABLE);
+        int test = validate(schema, rule->child[i], sub_program(step, i), node,
+            NOT_ABORTABLE);
 
         if (test != SCHEMA_VALID)
         {
@@ -1202,8 +1565,8 @@ static int test_all_of(const schema_t *schema, const json_t *rule, const json_t
     return SCHEMA_VALID;
 }
 
-static int test_if(const schema_t *schema, const json_t *parent, unsigned *child,
-    const json_t *node)
+static int test_if(const schema_t *schema, const json_t *parent,
+    const program_t *program, unsigned *child, const json_t *node)
 {
     unsigned index = *child;
     const json_t *rule = parent->child[index];
@@ -1235,7 +1598,8 @@ static int test_if(const schema_t *schema, const json_t *parent, unsigned *child
     }
 
     int result = rule->type == JSON_OBJECT
-        ? validate(schema, rule, node, NOT_ABORTABLE)
+        ? validate(schema, rule, program ? program->steps[index].program : NULL, node,
+            NOT_ABORTABLE)
         : rule->type == JSON_TRUE;
 
     if (result == SCHEMA_ABORT)
@@ -1249,8 +1613,8 @@ static int test_if(const schema_t *schema, const json_t *parent, unsigned *child
     return SCHEMA_VALID;
 }
 
-static int test_branch(const schema_t *schema, const json_t *parent, unsigned *child,
-    const json_t *node, int abortable)
+static int test_branch(const schema_t *schema, const json_t *parent,
+    const program_t *program, unsigned *child, const json_t *node, int abortable)
 {
     unsigned index = *child;
     const json_t *rule = parent->child[index];
@@ -1258,7 +1622,8 @@ static int test_branch(const schema_t *schema, const json_t *parent, unsigned *c
 
     if (rule->type == JSON_OBJECT)
     {
-        result = validate(schema, rule, node, abortable);
+        result = validate(schema, rule, program ? program->steps[index].program : NULL, node,
+            abortable);
     }
     else if (rule->type == JSON_FALSE)
     {
@@ -1295,14 +1660,15 @@ static int test_x_notify(const schema_t *schema, const json_t *rule, const json_
     return SCHEMA_VALID;
 }
 
-static int validate(const schema_t *schema, const json_t *rule, const json_t *node,
-    int abortable)
+static int validate(const schema_t *schema, const json_t *rule, const program_t *program,
+    const json_t *node, int abortable)
 {
     int result = SCHEMA_VALID;
 
     for (unsigned i = 0; i < rule->size; i++)
     {
-        int test = get_test(rule->child[i]);
+        const struct step *step = program ? &program->steps[i] : NULL;
+        int test = step ? step->test : get_test(rule->child[i]);
 
         switch (test)
         {
@@ -1319,22 +1685,24 @@ static int validate(const schema_t *schema, const json_t *rule, const json_t *no
                 return SCHEMA_ABORT;
             // Validate object related tests
             case SCHEMA_PROPERTIES:
-                test = test_properties(schema, rule->child[i], node, abortable);
+                test = test_properties(schema, rule->child[i], node, abortable, step);
                 break;
             case SCHEMA_PATTERN_PROPERTIES:
-                test = test_pattern_properties(schema, rule->child[i], node, abortable);
+                test = test_pattern_properties(schema, rule->child[i], node, abortable,
+                    step);
                 break;
             case SCHEMA_ADDITIONAL_PROPERTIES:
-                test = test_additional_properties(schema, rule, rule->child[i], node, abortable);
+                test = test_additional_properties(schema, rule, program, rule->child[i], node,
+                    abortable, step);
                 break;
             case SCHEMA_PROPERTY_NAMES:
-                test = test_property_names(schema, rule->child[i], node, abortable);
+                test = test_property_names(schema, rule->child[i], node, abortable, step);
                 break;
             case SCHEMA_REQUIRED:
                 test = test_required(schema, rule->child[i], node, abortable);
                 break;
             case SCHEMA_DEPENDENCIES:
-                test = test_dependencies(schema, rule->child[i], node, abortable);
+                test = test_dependencies(schema, rule->child[i], node, abortable, step);
                 break;
             case SCHEMA_MIN_PROPERTIES:
                 test = test_min_properties(rule->child[i], node);
@@ -1344,16 +1712,17 @@ static int validate(const schema_t *schema, const json_t *rule, const json_t *no
                 break;
             // Validate array related tests
             case SCHEMA_ITEMS:
-                test = test_items(schema, rule->child[i], node, abortable);
+                test = test_items(schema, rule->child[i], node, abortable, step);
                 break;
             case SCHEMA_ADDITIONAL_ITEMS:
-                test = test_additional_items(schema, rule, rule->child[i], node, abortable);
+                test = test_additional_items(schema, rule, program, rule->child[i], node,
+                    abortable, step);
                 break;
             case SCHEMA_UNIQUE_ITEMS:
                 test = test_unique_items(rule->child[i], node);
                 break;
             case SCHEMA_CONTAINS:
-                test = test_contains(schema, rule->child[i], node);
+                test = test_contains(schema, rule->child[i], node, step);
                 break;
             case SCHEMA_MIN_ITEMS:
                 test = test_min_items(rule->child[i], node);
@@ -1366,7 +1735,7 @@ static int validate(const schema_t *schema, const json_t *rule, const json_t *no
                 test = test_format(rule->child[i], node);
                 break;
             case SCHEMA_PATTERN:
-                test = test_pattern(rule->child[i], node);
+                test = test_pattern(rule->child[i], node, step);
                 break;
             case SCHEMA_X_MASK:
                 test = test_x_mask(rule->child[i], node);
@@ -1398,36 +1767,36 @@ static int validate(const schema_t *schema, const json_t *rule, const json_t *no
                 test = test_const(rule->child[i], node);
                 break;
             case SCHEMA_ENUM:
-                test = test_enum(rule->child[i], node);
+                test = test_enum(rule->child[i], node, step);
                 break;
             case SCHEMA_TYPE:
-                test = test_type(rule->child[i], node);
+                test = test_type(rule->child[i], node, step);
                 break;
             // Validate references
             case SCHEMA_REF:
-                test = test_ref(schema, rule->child[i], node, abortable);
+                test = test_ref(schema, rule->child[i], node, abortable, step);
                 break;
             // Validate special case 'not'
             case SCHEMA_NOT:
-                test = test_not(schema, rule->child[i], node);
+                test = test_not(schema, rule->child[i], node, step);
                 break;
             // Validate combinators tests
             case SCHEMA_ANY_OF:
-                test = test_any_of(schema, rule->child[i], node);
+                test = test_any_of(schema, rule->child[i], node, step);
                 break;
             case SCHEMA_ONE_OF:
-                test = test_one_of(schema, rule->child[i], node);
+                test = test_one_of(schema, rule->child[i], node, step);
                 break;
             case SCHEMA_ALL_OF:
-                test = test_all_of(schema, rule->child[i], node);
+                test = test_all_of(schema, rule->child[i], node, step);
                 break;
             // Validate logical tests
             case SCHEMA_IF:
-                test = test_if(schema, rule, &i, node);
+                test = test_if(schema, rule, program, &i, node);
                 break;
             case SCHEMA_THEN:
             case SCHEMA_ELSE:
-                test = test_branch(schema, rule, &i, node, abortable);
+                test = test_branch(schema, rule, program, &i, node, abortable);
                 break;
             // Notification to user-callback (extension)
             case SCHEMA_X_NOTIFY:
@@ -1484,6 +1853,491 @@ int json_validate(const json_t *rule, const json_t *node, const map_t *map,
     {
         return SCHEMA_INVALID;
     }
-    return validate(&schema, rule, node, ABORTABLE) == SCHEMA_VALID;
+    return validate(&schema, rule, NULL, node, ABORTABLE) == SCHEMA_VALID;
+}
+
+
+/*
+--------------------------------------------------------
+Compiled schemas
+--------------------------------------------------------
+json_schema_compile resolves once what json_validate
+looks up on every call: the keyword of each member, the
+targets of '$ref', the masks of 'type', the regexes and
+the siblings read by additionalProperties/Items
+
+Each rule object gets a program with one step per
+member, steps point directly to the programs of their
+subschemas, validation is the same interpreter walking
+the steps (a step missing something falls back to the
+lookups of json_validate, so the results and the
+events are the same)
+
+The rule and the map must outlive the compiled schema
+--------------------------------------------------------
+*/
+
+static size_t hash_rule(const json_t *rule, size_t slots)
+{
+    return (size_t)(((uintptr_t)rule >> 4) * 0x9E3779B97F4A7C15u >> 32) & (slots - 1);
+}
+
+static program_t **find_slot(const json_schema_t *schema, const json_t *rule)
+{
+    size_t slot = hash_rule(rule, schema->slots);
+
+    while ((schema->hash[slot] != NULL) && (schema->hash[slot]->rule != rule))
+    {
+        slot = (slot + 1) & (schema->slots - 1);
+    }
+    return &schema->hash[slot];
+}
+
+static int grow_table(json_schema_t *schema)
+{
+    program_t **hash = schema->hash;
+    size_t slots = schema->slots;
+
+    schema->slots = slots ? slots * 2 : 64;
+    schema->hash = calloc(schema->slots, sizeof *schema->hash);
+    if (schema->hash == NULL)
+    {
+        schema->hash = hash;
+        schema->slots = slots;
+        return 0;
+    }
+    for (size_t i = 0; i < slots; i++)
+    {
+        if (hash[i] != NULL)
+        {
+            *find_slot(schema, hash[i]->rule) = hash[i];
+        }
+    }
+    free(hash);
+    return 1;
+}
+
+/* Returns (in 'program') the program of a subschema, new programs are compiled later */
+static int add_program(json_schema_t *schema, const json_t *rule, const program_t **program)
+{
+    *program = NULL;
+    if ((rule == NULL) || (rule->type != JSON_OBJECT))
+    {
+        return 1;
+    }
+    if ((schema->size >= schema->slots / 2) && !grow_table(schema))
+    {
+        return 0;
+    }
+
+    program_t **slot = find_slot(schema, rule);
+
+    if (*slot == NULL)
+    {
+        if (schema->size == schema->room)
+        {
+            size_t room = schema->room ? schema->room * 2 : 32;
+            program_t **list = realloc(schema->list, sizeof(*list) * room);
+
+            if (list == NULL)
+            {
+                return 0;
+            }
+            schema->list = list;
+            schema->room = room;
+        }
+        *slot = calloc(1, sizeof(**slot) + sizeof(struct step) * rule->size);
+        if (*slot == NULL)
+        {
+            return 0;
+        }
+        (*slot)->rule = rule;
+        schema->list[schema->size++] = *slot;
+    }
+    *program = *slot;
+    return 1;
+}
+
+static int add_programs(json_schema_t *schema, struct step *step, const json_t *rule)
+{
+    if (!(rule->type & JSON_ITERABLE) || (rule->size == 0))
+    {
+        return 1;
+    }
+    CHECK(step->programs = calloc(rule->size, sizeof *step->programs));
+    for (unsigned i = 0; i < rule->size; i++)
+    {
+        CHECK(add_program(schema, rule->child[i], &step->programs[i]));
+    }
+    return 1;
+}
+
+/* Large enums are hashed, on failure values are searched linearly */
+static int add_values(struct step *step, const json_t *rule)
+{
+    if ((rule->type != JSON_ARRAY) || (rule->size < ENUM_HASHED_MIN))
+    {
+        return 1;
+    }
+    CHECK(step->values = malloc(sizeof *step->values));
+    if (!json_hashset_init(step->values, rule))
+    {
+        free(step->values);
+        step->values = NULL;
+        return 1;
+    }
+    for (unsigned i = 0; i < rule->size; i++)
+    {
+        json_hashset_insert(step->values, i);
+    }
+    return 1;
+}
+
+/* Invalid regexes are left as NULL (never match, as in test_regex) */
+static int add_patterns(struct step *step, const json_t *rule)
+{
+    if ((rule->type != JSON_OBJECT) || (rule->size == 0))
+    {
+        return 1;
+    }
+    CHECK(step->patterns = calloc(rule->size, sizeof *step->patterns));
+    for (unsigned i = 0; i < rule->size; i++)
+    {
+        step->patterns[i] = pattern_create(rule->child[i]->key);
+    }
+    return 1;
+}
+
+static int compile_step(json_schema_t *schema, struct step *step, const json_t *rule)
+{
+    switch (step->test = get_test(rule))
+    {
+        case SCHEMA_PATTERN_PROPERTIES:
+            CHECK(add_patterns(step, rule));
+            return add_programs(schema, step, rule);
+        case SCHEMA_PROPERTIES:
+        case SCHEMA_DEPENDENCIES:
+            return (rule->type != JSON_OBJECT) || add_programs(schema, step, rule);
+        case SCHEMA_ALL_OF:
+        case SCHEMA_ANY_OF:
+        case SCHEMA_ONE_OF:
+            return (rule->type != JSON_ARRAY) || add_programs(schema, step, rule);
+        case SCHEMA_ITEMS:
+            if (rule->type == JSON_ARRAY)
+            {
+                return add_programs(schema, step, rule);
+            }
+            return add_program(schema, rule, &step->program);
+        case SCHEMA_ADDITIONAL_ITEMS:
+        case SCHEMA_ADDITIONAL_PROPERTIES:
+        case SCHEMA_CONTAINS:
+        case SCHEMA_PROPERTY_NAMES:
+        case SCHEMA_NOT:
+        case SCHEMA_IF:
+        case SCHEMA_THEN:
+        case SCHEMA_ELSE:
+            return add_program(schema, rule, &step->program);
+        case SCHEMA_REF:
+            if (rule->type != JSON_STRING)
+            {
+                return 1;
+            }
+            return add_program(schema,
+                resolve_ref(schema->rule, schema->map, rule->string), &step->program);
+        case SCHEMA_PATTERN:
+            if (rule->type == JSON_STRING)
+            {
+                step->pattern = pattern_create(rule->string);
+            }
+            return 1;
+        case SCHEMA_ENUM:
+            return add_values(step, rule);
+        case SCHEMA_TYPE:
+            // On error the mask is computed (and the error raised) when validating
+            if (!type_mask(rule, &step->mask))
+            {
+                step->mask = 0;
+            }
+            return 1;
+        default:
+            return 1;
+    }
+}
+
+static int compile_program(json_schema_t *schema, program_t *program)
+{
+    const json_t *rule = program->rule;
+
+    for (unsigned i = 0; i < rule->size; i++)
+    {
+        CHECK(compile_step(schema, &program->steps[i], rule->child[i]));
+    }
+    program->properties = json_find(rule, "properties");
+    program->patterns = json_find(rule, "patternProperties");
+    program->items = json_find(rule, "items");
+
+    unsigned index = json_index(rule, "patternProperties");
+
+    if (index != JSON_NOT_FOUND)
+    {
+        program->regexes = program->steps[index].patterns;
+    }
+    return 1;
+}
+
+static int compile(json_schema_t *schema)
+{
+    CHECK(add_program(schema, schema->rule, &schema->root));
+    // Programs added while compiling are compiled in turn
+    for (size_t i = 0; i < schema->size; i++)
+    {
+        CHECK(compile_program(schema, schema->list[i]));
+    }
+    return 1;
+}
+
+/* Compiles a schema for repeated validations with json_schema_validate */
+json_schema_t *json_schema_compile(const json_t *rule, const map_t *map)
+{
+    if ((rule == NULL) || !(rule->type & (JSON_OBJECT | JSON_TRUE)))
+    {
+        return NULL;
+    }
+
+    json_schema_t *schema = calloc(1, sizeof *schema);
+
+    if (schema == NULL)
+    {
+        return NULL;
+    }
+    schema->rule = rule;
+    schema->map = map;
+    if (!compile(schema))
+    {
+        json_schema_destroy(schema);
+        return NULL;
+    }
+    return schema;
+}
+
+/* Same as json_validate with a compiled schema */
+int json_schema_validate(const json_schema_t *compiled, const json_t *node,
+    json_validate_callback callback, void *data)
+{
+    if ((compiled == NULL) || (node == NULL))
+    {
+        return SCHEMA_INVALID;
+    }
+
+    struct tracker active = { 0 };
+    const schema_t schema =
+    {
+        .rule = compiled->rule, .node = node, .map = compiled->map,
+        .callback = callback, .data = data,
+        .active = &active
+    };
+
+    return validate(&schema, compiled->rule, compiled->root, node, ABORTABLE) == SCHEMA_VALID;
+}
+
+static void destroy_step(struct step *step, size_t size)
+{
+    if (step->patterns != NULL)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            pattern_destroy(step->patterns[i]);
+        }
+        free(step->patterns);
+    }
+    if (step->values != NULL)
+    {
+        json_hashset_free(step->values);
+        free(step->values);
+    }
+    pattern_destroy(step->pattern);
+    free(step->programs);
+}
+
+void json_schema_destroy(json_schema_t *schema)
+{
+    if (schema == NULL)
+    {
+        return;
+    }
+    for (size_t i = 0; i < schema->size; i++)
+    {
+        const json_t *rule = schema->list[i]->rule;
+
+        for (unsigned j = 0; j < rule->size; j++)
+        {
+            destroy_step(&schema->list[i]->steps[j], rule->child[j]->size);
+        }
+        free(schema->list[i]);
+    }
+    free(schema->list);
+    free(schema->hash);
+    free(schema);
 }
 
+/*
+--------------------------------------------------------
+Batch validation
+--------------------------------------------------------
+json_validate_batch compiles the schema once and
+validates the documents on a pool of threads, workers
+take small runs of documents from a shared counter
+until there are no more documents left
+
+The callback (optional) gets the index of the document
+along with the event, it is called from the workers but
+never concurrently, the events of a document are in
+order, documents are interleaved in any order, the
+callback returning non 0 stops that document only
+--------------------------------------------------------
+*/
+
+// Documents taken by a worker at once
+#define BATCH_RUN 16
+
+struct batch
+{
+    json_schema_t *compiled;
+    const json_t *rule;
+    const map_t *map;
+    const json_t * const *nodes;
+    int *results;
+    size_t size, next, valid;
+    json_batch_callback callback;
+    void *data;
+    pthread_mutex_t mutex;
+};
+
+struct batch_event
+{
+    struct batch *batch;
+    size_t index;
+};
+
+static int batch_notify(const json_event_t *event, void *data)
+{
+    const struct batch_event *context = data;
+    struct batch *batch = context->batch;
+
+    pthread_mutex_lock(&batch->mutex);
+
+    int rc = batch->callback(event, context->index, batch->data);
+
+    pthread_mutex_unlock(&batch->mutex);
+    return rc;
+}
+
+static int batch_validate(struct batch *batch, size_t index)
+{
+    const json_t *node = batch->nodes[index];
+
+    if (node == NULL)
+    {
+        return 0;
+    }
+
+    struct batch_event context = { .batch = batch, .index = index };
+    struct tracker active = { 0 };
+    const schema_t schema =
+    {
+        .rule = batch->rule, .node = node, .map = batch->map,
+        .callback = batch->callback ? batch_notify : NULL, .data = &context,
+        .active = &active,
+        .sequential = 1
+    };
+    const program_t *program = batch->compiled ? batch->compiled->root : NULL;
+
+    return validate(&schema, batch->rule, program, node, ABORTABLE) == SCHEMA_VALID;
+}
+
+static void *batch_worker(void *data)
+{
+    struct batch *batch = data;
+    size_t valid = 0;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&batch->mutex);
+
+        size_t from = batch->next;
+        size_t to = batch->size - from > BATCH_RUN ? from + BATCH_RUN : batch->size;
+
+        batch->next = to;
+        pthread_mutex_unlock(&batch->mutex);
+        if (from == to)
+        {
+            break;
+        }
+        for (size_t i = from; i < to; i++)
+        {
+            int result = batch_validate(batch, i);
+
+            if (batch->results != NULL)
+            {
+                batch->results[i] = result;
+            }
+            valid += (size_t)result;
+        }
+    }
+    pthread_mutex_lock(&batch->mutex);
+    batch->valid += valid;
+    pthread_mutex_unlock(&batch->mutex);
+    return NULL;
+}
+
+/**
+ * Validates 'size' documents against the same schema using 'threads' threads
+ * (0 = one per online core), 'results' (optional) gets 1 or 0 per document
+ * Returns the number of valid documents
+ */
+size_t json_validate_batch(const json_t *rule, const json_t * const nodes[], size_t size,
+    const map_t *map, int results[], unsigned threads,
+    json_batch_callback callback, void *data)
+{
+    if ((nodes == NULL) || (size == 0))
+    {
+        return 0;
+    }
+    if ((rule == NULL) || !(rule->type & (JSON_OBJECT | JSON_TRUE)))
+    {
+        if (results != NULL)
+        {
+            memset(results, 0, sizeof(*results) * size);
+        }
+        return 0;
+    }
+
+    struct batch batch =
+    {
+        // Interpreted if it can not be compiled
+        .compiled = json_schema_compile(rule, map),
+        .rule = rule, .map = map,
+        .nodes = nodes, .results = results, .size = size,
+        .callback = callback, .data = data
+    };
+    size_t count = pool_threads(threads, (size + BATCH_RUN - 1) / BATCH_RUN);
+    pthread_t *thread = count > 1 ? malloc(sizeof(*thread) * (count - 1)) : NULL;
+    size_t started = 0;
+
+    pthread_mutex_init(&batch.mutex, NULL);
+    while ((thread != NULL) && (started < count - 1) &&
+           (pthread_create(&thread[started], NULL, batch_worker, &batch) == 0))
+    {
+        started++;
+    }
+    // The calling thread is one of the workers
+    batch_worker(&batch);
+    for (size_t i = 0; i < started; i++)
+    {
+        pthread_join(thread[i], NULL);
+    }
+    pthread_mutex_destroy(&batch.mutex);
+    free(thread);
+    json_schema_destroy(batch.compiled);
+    return batch.valid;
+}
@@ -0,0 +1,72 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+/*
+--------------------------------------------------------
+Explicit stack for non recursive traversals
+--------------------------------------------------------
+- Nodes do not store their parent, the path from the
+  root to the current node is kept in a stack of frames
+  (node being traversed and index of the next child)
+- Traversals of two trees at once (equal, compare) keep
+  the matching node of the other tree in 'peer'
+- The first JSON_STACK_BASE frames live in the struct
+  itself, deeper documents spill to the heap
+- Readers (equal, compare, walk) report a failure when
+  the heap is exhausted, json_hash does not hash levels
+  deeper than the base and json_delete needs no stack
+--------------------------------------------------------
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "json_private.h"
+
+/* Pushes a frame for 'node' (and 'peer'), returns 0 on allocation failure */
+int json_stack_push(struct json_stack *stack,
+    const struct json *node, const struct json *peer)
+{
+    if (stack->size == stack->room)
+    {
+        struct json_frame *frame;
+
+        if (stack->room == 0)
+        {
+            frame = stack->base;
+            stack->room = JSON_STACK_BASE;
+        }
+        else if (stack->frame == stack->base)
+        {
+            if ((frame = malloc(sizeof(*frame) * stack->room * 2)) == NULL)
+            {
+                return 0;
+            }
+            memcpy(frame, stack->base, sizeof(*frame) * stack->size);
+            stack->room *= 2;
+        }
+        else
+        {
+            if ((frame = realloc(stack->frame, sizeof(*frame) * stack->room * 2)) == NULL)
+            {
+                return 0;
+            }
+            stack->room *= 2;
+        }
+        stack->frame = frame;
+    }
+    stack->frame[stack->size++] = (struct json_frame){ node, peer, 0 };
+    return 1;
+}
+
+void json_stack_free(struct json_stack *stack)
+{
+    if (stack->frame != stack->base)
+    {
+        free(stack->frame);
+    }
+    stack->frame = NULL;
+    stack->size = stack->room = 0;
+}
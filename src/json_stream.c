@@ -0,0 +1,659 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "clib_math.h"
+#include "clib_number.h"
+#include "clib_scan.h"
+#include "clib_unicode.h"
+#include "json_stream.h"
+
+/**
+ * Pull parser: returns one token per call without building a tree.
+ * Input comes from a buffer, a file descriptor or chunks passed with
+ * json_stream_feed(). Only the bytes of the token being read are kept,
+ * a token split across chunks is scanned again once the rest arrives
+ * (strings resume at the point where the scan stopped).
+ * The grammar, the depth limit (json_parser_set_max_depth) and the
+ * line/column of errors are the same as in json_parse.
+ */
+
+enum state
+{
+    EXPECT_VALUE,       // Root, after ':' or after ',' in an array
+    EXPECT_FIRST_VALUE, // After '['
+    EXPECT_FIRST_KEY,   // After '{'
+    EXPECT_KEY,         // After ',' in an object
+    EXPECT_COLON,       // After a key
+    EXPECT_COMMA,       // After a value in an iterable
+    EXPECT_END,         // After the root value
+    STREAM_DONE,
+    STREAM_FAILED
+};
+
+struct json_stream
+{
+    // Unread input: [text + head, text + tail)
+    const char *text;
+    size_t head, tail;
+    // Owned input buffer when the stream is not reading from a user buffer
+    char *buffer;
+    size_t size;
+    // Descriptor to read from or -1 when the input is fed by the user
+    int fd;
+    // No more input is expected
+    int last;
+    // Offset from 'head' where the scan of a split string is resumed
+    size_t resume;
+    // Line and column of 'text + mark' (consumed input is accounted on discard)
+    size_t mark;
+    json_error_t position;
+    json_error_t error;
+    // Iterables currently open: '{' or '['
+    char *stack;
+    size_t depth, room;
+    enum state state;
+    // Decoded key or string and number of the last token
+    char *value;
+    size_t length, value_size;
+    double number;
+};
+
+static json_stream_t *new_stream(void)
+{
+    json_stream_t *stream = calloc(1, sizeof *stream);
+
+    if (stream != NULL)
+    {
+        stream->fd = -1;
+        stream->position.line = stream->position.column = 1;
+    }
+    return stream;
+}
+
+/* Returns a stream fed by the user with json_stream_feed() */
+json_stream_t *json_stream_create(void)
+{
+    return new_stream();
+}
+
+/* Returns a stream reading from 'text' (the text is not copied) */
+json_stream_t *json_stream_buffer(const char *text, size_t length)
+{
+    if (text == NULL)
+    {
+        return NULL;
+    }
+
+    json_stream_t *stream = new_stream();
+
+    if (stream != NULL)
+    {
+        stream->text = text;
+        stream->tail = length;
+        stream->last = 1;
+    }
+    return stream;
+}
+
+/* Returns a stream reading from the descriptor 'fd' (not closed on destroy) */
+json_stream_t *json_stream_fd(int fd)
+{
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    json_stream_t *stream = new_stream();
+
+    if (stream != NULL)
+    {
+        stream->fd = fd;
+    }
+    return stream;
+}
+
+/* Counts lines and columns (as json_parse does) up to 'text + offset' */
+static void advance(json_stream_t *stream, size_t offset)
+{
+    const char *str = stream->text + stream->mark;
+    const char *end = stream->text + offset;
+    const char *eol;
+
+    if (str == end)
+    {
+        return;
+    }
+    while ((eol = memchr(str, '\n', (size_t)(end - str))) != NULL)
+    {
+        stream->position.line++;
+        stream->position.column = 1;
+        str = eol + 1;
+    }
+    while (str < end)
+    {
+        stream->position.column += is_utf8(*str++);
+    }
+    stream->mark = offset;
+}
+
+/* Discards the consumed input and makes room for 'length' more bytes */
+static int reserve(json_stream_t *stream, size_t length)
+{
+    size_t unread = stream->tail - stream->head;
+
+    advance(stream, stream->head);
+    if (stream->head > 0)
+    {
+        memmove(stream->buffer, stream->buffer + stream->head, unread);
+        stream->head = stream->mark = 0;
+        stream->tail = unread;
+    }
+    if (unread + length > stream->size)
+    {
+        size_t size = stream->size ? stream->size : 4096;
+
+        while (size < unread + length)
+        {
+            size *= 2;
+        }
+
+        char *buffer = realloc(stream->buffer, size);
+
+        if (buffer == NULL)
+        {
+            return 0;
+        }
+        stream->buffer = buffer;
+        stream->size = size;
+    }
+    stream->text = stream->buffer;
+    return 1;
+}
+
+/**
+ * Appends a chunk of input, the chunk can split tokens at any point
+ * Returns 0 on failure (out of memory or the input was finished)
+ */
+int json_stream_feed(json_stream_t *stream, const char *chunk, size_t length)
+{
+    if ((stream == NULL) || (chunk == NULL) || stream->last || (stream->fd != -1))
+    {
+        return 0;
+    }
+    if (length == 0)
+    {
+        return 1;
+    }
+    if (!reserve(stream, length))
+    {
+        return 0;
+    }
+    memcpy(stream->buffer + stream->tail, chunk, length);
+    stream->tail += length;
+    return 1;
+}
+
+/* Signals the end of the input */
+void json_stream_finish(json_stream_t *stream)
+{
+    if (stream != NULL)
+    {
+        stream->last = 1;
+    }
+}
+
+/* Reads the next block from the descriptor, returns 0 on failure */
+static int read_more(json_stream_t *stream)
+{
+    if (!reserve(stream, 65536))
+    {
+        return 0;
+    }
+    for (;;)
+    {
+        ssize_t bytes = read(stream->fd, stream->buffer + stream->tail,
+                             stream->size - stream->tail);
+
+        if (bytes > 0)
+        {
+            stream->tail += (size_t)bytes;
+            return 1;
+        }
+        if (bytes == 0)
+        {
+            stream->last = 1;
+            return 1;
+        }
+        if (errno != EINTR)
+        {
+            return 0;
+        }
+    }
+}
+
+/* Syntax error at 'text + offset' */
+static enum json_token fail(json_stream_t *stream, size_t offset)
+{
+    advance(stream, offset);
+    stream->error = stream->position;
+    stream->state = STREAM_FAILED;
+    return JSON_TOKEN_ERROR;
+}
+
+/* Out of memory or read error (line and column are 0) */
+static enum json_token abort_stream(json_stream_t *stream)
+{
+    stream->error.line = stream->error.column = 0;
+    stream->state = STREAM_FAILED;
+    return JSON_TOKEN_ERROR;
+}
+
+/* A split token was found, returns JSON_TOKEN_MORE if the input can grow */
+static enum json_token need_more(json_stream_t *stream)
+{
+    if (stream->fd != -1)
+    {
+        return read_more(stream) ? JSON_TOKEN_MORE : abort_stream(stream);
+    }
+    return JSON_TOKEN_MORE;
+}
+
+static int open_iterable(json_stream_t *stream, char type)
+{
+    if (stream->depth == stream->room)
+    {
+        size_t room = stream->room ? stream->room * 2 : 32;
+        char *temp = realloc(stream->stack, room);
+
+        if (temp == NULL)
+        {
+            return 0;
+        }
+        stream->stack = temp;
+        stream->room = room;
+    }
+    stream->stack[stream->depth++] = type;
+    return 1;
+}
+
+static void close_value(json_stream_t *stream)
+{
+    stream->state = stream->depth > 0 ? EXPECT_COMMA : EXPECT_END;
+}
+
+/**
+ * Scans the body of a string, 'str' is set to the closing quote or to the
+ * first invalid character, returns 0 if the string is split
+ */
+static int scan_string(const char **str, const char *end)
+{
+    const char *ptr = *str;
+
+    while ((ptr = scan_quotes(ptr, end)) < end)
+    {
+        if (*ptr != '\\')
+        {
+            *str = ptr;
+            return 1;
+        }
+        if (end - ptr < 2)
+        {
+            break;
+        }
+        if (is_esc(ptr + 1))
+        {
+            ptr += 2;
+        }
+        else if (ptr[1] != 'u')
+        {
+            *str = ptr;
+            return 1;
+        }
+        else if (end - ptr < 6)
+        {
+            break;
+        }
+        else if (is_hex(ptr + 1))
+        {
+            ptr += 6;
+        }
+        else
+        {
+            *str = ptr;
+            return 1;
+        }
+    }
+    *str = ptr;
+    return 0;
+}
+
+static enum json_token read_string(json_stream_t *stream, enum json_token token)
+{
+    const char *start = stream->text + stream->head + 1;
+    const char *end = stream->text + stream->tail;
+    const char *str = start + stream->resume;
+
+    if (!scan_string(&str, end))
+    {
+        if (!stream->last)
+        {
+            stream->resume = (size_t)(str - start);
+            return need_more(stream);
+        }
+        return fail(stream, (size_t)(str - stream->text));
+    }
+    stream->resume = 0;
+    if (*str != '"')
+    {
+        return fail(stream, (size_t)(str - stream->text));
+    }
+
+    size_t size = (size_t)(str - start) + 1;
+
+    if (size > stream->value_size)
+    {
+        char *value = realloc(stream->value, size);
+
+        if (value == NULL)
+        {
+            return abort_stream(stream);
+        }
+        stream->value = value;
+        stream->value_size = size;
+    }
+    stream->length = decode_string(stream->value, start, str);
+    stream->head = (size_t)(str - stream->text) + 1;
+    if (token == JSON_TOKEN_KEY)
+    {
+        stream->state = EXPECT_COLON;
+    }
+    else
+    {
+        close_value(stream);
+    }
+    return token;
+}
+
+static int is_numeric(int c)
+{
+    return is_digit(c) || (c == '-') || (c == '+') || (c == '.') || (c == 'e') || (c == 'E');
+}
+
+static enum json_token read_number(json_stream_t *stream)
+{
+    const char *str = stream->text + stream->head;
+    const char *end = stream->text + stream->tail;
+    const char *run = str;
+
+    while ((run < end) && is_numeric(*run))
+    {
+        run++;
+    }
+    if ((run == end) && !stream->last)
+    {
+        return need_more(stream);
+    }
+
+    int integer;
+
+    run = str;
+    if (!number_parse(&run, end, &stream->number, &integer))
+    {
+        return fail(stream, (size_t)(run - stream->text));
+    }
+    stream->head = (size_t)(run - stream->text);
+    close_value(stream);
+    // Safe integers as in json_parse
+    return integer && IS_SAFE_INTEGER(stream->number) ? JSON_TOKEN_INTEGER : JSON_TOKEN_REAL;
+}
+
+static enum json_token read_literal(json_stream_t *stream, const char *name,
+    size_t length, enum json_token token)
+{
+    if (stream->tail - stream->head < length)
+    {
+        return stream->last ? fail(stream, stream->head) : need_more(stream);
+    }
+    if (memcmp(stream->text + stream->head, name, length))
+    {
+        return fail(stream, stream->head);
+    }
+    stream->head += length;
+    close_value(stream);
+    return token;
+}
+
+static enum json_token read_value(json_stream_t *stream)
+{
+    switch (stream->text[stream->head])
+    {
+        case '{':
+            if (!open_iterable(stream, '{'))
+            {
+                return abort_stream(stream);
+            }
+            stream->head++;
+            stream->state = EXPECT_FIRST_KEY;
+            return JSON_TOKEN_OBJECT;
+        case '[':
+            if (!open_iterable(stream, '['))
+            {
+                return abort_stream(stream);
+            }
+            stream->head++;
+            stream->state = EXPECT_FIRST_VALUE;
+            return JSON_TOKEN_ARRAY;
+        case '"':
+            return read_string(stream, JSON_TOKEN_STRING);
+        case '-':
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            return read_number(stream);
+        case 't':
+            return read_literal(stream, "true", 4, JSON_TOKEN_TRUE);
+        case 'f':
+            return read_literal(stream, "false", 5, JSON_TOKEN_FALSE);
+        case 'n':
+            return read_literal(stream, "null", 4, JSON_TOKEN_NULL);
+        default:
+            return fail(stream, stream->head);
+    }
+}
+
+static enum json_token close_iterable(json_stream_t *stream)
+{
+    char type = stream->stack[--stream->depth];
+
+    stream->head++;
+    close_value(stream);
+    return type == '{' ? JSON_TOKEN_OBJECT_END : JSON_TOKEN_ARRAY_END;
+}
+
+/* Members of an iterable at depth >= max_depth are rejected (as in json_parse) */
+static int too_deep(const json_stream_t *stream)
+{
+    return stream->depth - 1 >= json_parser_get_max_depth();
+}
+
+/**
+ * Returns the next token, JSON_TOKEN_MORE means that the stream must be fed
+ * (json_stream_feed or json_stream_finish) before calling it again
+ */
+enum json_token json_stream_next(json_stream_t *stream)
+{
+    if (stream == NULL)
+    {
+        return JSON_TOKEN_ERROR;
+    }
+    for (;;)
+    {
+        switch (stream->state)
+        {
+            case STREAM_DONE:
+                return JSON_TOKEN_END;
+            case STREAM_FAILED:
+                return JSON_TOKEN_ERROR;
+            default:
+                break;
+        }
+        // Skip spaces, a split token is resumed without skipping
+        if (stream->resume == 0)
+        {
+            const char *str = stream->text + stream->head;
+
+            stream->head = (size_t)(scan_spaces(str, stream->text + stream->tail) - stream->text);
+        }
+        if (stream->head == stream->tail)
+        {
+            if (!stream->last)
+            {
+                enum json_token token = need_more(stream);
+
+                if ((token == JSON_TOKEN_MORE) && (stream->fd != -1))
+                {
+                    continue;
+                }
+                return token;
+            }
+            if (stream->state == EXPECT_END)
+            {
+                stream->state = STREAM_DONE;
+                return JSON_TOKEN_END;
+            }
+            return fail(stream, stream->head);
+        }
+
+        enum json_token token;
+        char c = stream->text[stream->head];
+
+        switch (stream->state)
+        {
+            case EXPECT_VALUE:
+                if ((stream->depth > 0) && (stream->stack[stream->depth - 1] == '[') &&
+                    too_deep(stream))
+                {
+                    return fail(stream, stream->head);
+                }
+                token = read_value(stream);
+                break;
+            case EXPECT_FIRST_VALUE:
+                if (c == ']')
+                {
+                    return close_iterable(stream);
+                }
+                if (too_deep(stream))
+                {
+                    return fail(stream, stream->head);
+                }
+                token = read_value(stream);
+                break;
+            case EXPECT_FIRST_KEY:
+                if (c == '}')
+                {
+                    return close_iterable(stream);
+                }
+                __attribute__((fallthrough));
+            case EXPECT_KEY:
+                if ((c != '"') || too_deep(stream))
+                {
+                    return fail(stream, stream->head);
+                }
+                token = read_string(stream, JSON_TOKEN_KEY);
+                break;
+            case EXPECT_COLON:
+                if (c != ':')
+                {
+                    return fail(stream, stream->head);
+                }
+                stream->head++;
+                stream->state = EXPECT_VALUE;
+                continue;
+            case EXPECT_COMMA:
+                if (c == ',')
+                {
+                    stream->head++;
+                    stream->state = stream->stack[stream->depth - 1] == '{'
+                        ? EXPECT_KEY
+                        : EXPECT_VALUE;
+                    continue;
+                }
+                if (c == (stream->stack[stream->depth - 1] == '{' ? '}' : ']'))
+                {
+                    return close_iterable(stream);
+                }
+                return fail(stream, stream->head);
+            default:
+                // Garbage after the root value
+                return fail(stream, stream->head);
+        }
+        // Descriptors are read until the token is complete
+        if ((token != JSON_TOKEN_MORE) || (stream->fd == -1))
+        {
+            return token;
+        }
+    }
+}
+
+/* Decoded key or string of the last JSON_TOKEN_KEY/JSON_TOKEN_STRING */
+const char *json_stream_text(const json_stream_t *stream)
+{
+    return stream && stream->value ? stream->value : "";
+}
+
+/* Length of the decoded key or string (it can contain '\0' as \u0000) */
+size_t json_stream_length(const json_stream_t *stream)
+{
+    return stream ? stream->length : 0;
+}
+
+/* Value of the last JSON_TOKEN_INTEGER/JSON_TOKEN_REAL */
+double json_stream_number(const json_stream_t *stream)
+{
+    return stream ? stream->number : 0;
+}
+
+/* Number of iterables currently open */
+unsigned json_stream_depth(const json_stream_t *stream)
+{
+    return stream ? (unsigned)stream->depth : 0;
+}
+
+/**
+ * Returns 1 and fills 'error' if the stream failed
+ * line and column are 0 on memory or read errors (see json_print_error)
+ */
+int json_stream_error(const json_stream_t *stream, json_error_t *error)
+{
+    int failed = (stream == NULL) || (stream->state == STREAM_FAILED);
+
+    if (error != NULL)
+    {
+        if (failed && (stream != NULL))
+        {
+            *error = stream->error;
+        }
+        else
+        {
+            error->line = error->column = 0;
+        }
+    }
+    return failed;
+}
+
+void json_stream_destroy(json_stream_t *stream)
+{
+    if (stream != NULL)
+    {
+        free(stream->buffer);
+        free(stream->stack);
+        free(stream->value);
+        free(stream);
+    }
+}
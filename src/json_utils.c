@@ -28,30 +28,44 @@ static int compare_node(const json_t *a, const json_t *b)
     }
 }
 
+/* The subtrees are traversed on an explicit stack */
 static int compare_children(const json_t *a, const json_t *b)
 {
-    unsigned size = a->size < b->size ? a->size : b->size;
+    struct json_stack stack = { 0 };
+    int cmp = 0;
 
-    for (unsigned i = 0; i < size; i++)
+    // The first frames are not allocated, this push can not fail
+    json_stack_push(&stack, a, b);
+    while ((cmp == 0) && (stack.size > 0))
     {
-        const json_t *c = a->child[i];
-        const json_t *d = b->child[i];
-        int cmp;
+        struct json_frame *frame = json_stack_top(&stack);
+        const json_t *c = frame->node;
+        const json_t *d = frame->peer;
 
-        if ((c->key != NULL) && (cmp = strcmp(c->key, d->key)))
+        if ((frame->index == c->size) || (frame->index == d->size))
         {
-            return cmp;
+            cmp = d->size > c->size ? -1 : c->size != d->size;
+            stack.size--;
+            continue;
+        }
+        c = c->child[frame->index];
+        d = d->child[frame->index];
+        frame->index++;
+        if ((c->key != d->key) && (c->key != NULL) && (cmp = strcmp(c->key, d->key)))
+        {
+            break;
         }
         if ((cmp = compare_node(c, d)))
         {
-            return cmp;
+            break;
         }
-        if ((c->size || d->size) && (cmp = compare_children(c, d)))
+        if ((c->size || d->size) && !json_stack_push(&stack, c, d))
         {
-            return cmp;
+            cmp = JSON_COMPARE_ERROR;
         }
     }
-    return b->size > a->size ? -1 : a->size != b->size;
+    json_stack_free(&stack);
+    return cmp;
 }
 
 /* Trusted comparators */
@@ -99,6 +113,7 @@ static int compare_by_key_value(const void *pa, const void *pb)
  * > 0 if a > b
  * < 0 if a < b
  * 0 otherwise
+ * JSON_COMPARE_ERROR if the stack of deep levels can not be allocated
  */
 int json_compare(const json_t *a, const json_t *b)
 {
@@ -152,6 +167,10 @@ void json_sort(json_t *node, json_sort_callback callback)
         callback = node->type == JSON_OBJECT ? compare_by_key_value : compare_by_value;
     }
     qsort(node->child, node->size, sizeof *node->child, callback);
+    if (node->packed & JSON_INDEXED)
+    {
+        json_keymap_reset(node);
+    }
 }
 
 /* Reverses a json iterable */
@@ -171,5 +190,9 @@ void json_reverse(json_t *node)
         node->child[lower++] = node->child[upper];
         node->child[upper--] = temp;
     }
+    if (node->packed & JSON_INDEXED)
+    {
+        json_keymap_reset(node);
+    }
 }
 
@@ -0,0 +1,598 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+/*
+--------------------------------------------------------
+Read-only views
+--------------------------------------------------------
+A view is a flat image of a tree that can be navigated
+in place, without decoding and without allocations, so
+a file can be mapped and shared between processes
+
+- A header (magic, version, byte order and length)
+  followed by the root node
+- Nodes are fixed size records, the children of an
+  iterable are stored in a contiguous block of records
+  (json_view_at is a pointer increment)
+- Keys and strings are '\0' terminated, keys are stored
+  once per image
+- Objects with at least JSON_KEYMAP_MIN members are
+  followed by their indexes sorted by key (binary
+  search in json_view_find)
+- Offsets are relative to the node holding them, any
+  part of an image is usable wherever it is loaded
+- Images are written in the byte order of the host,
+  the contents are trusted (only the header is checked)
+--------------------------------------------------------
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "clib_check.h"
+#include "clib_hashmap.h"
+#include "clib_stream.h"
+#include "json_private.h"
+#include "json_view.h"
+
+#define VIEW_MAGIC "JSONVIEW"
+#define VIEW_VERSION 1
+#define VIEW_ORDER 0x01020304
+
+enum { VIEW_SORTED = 0x01 };
+
+struct json_view_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t order;
+    uint64_t length;
+    uint64_t reserved;
+};
+
+struct json_view
+{
+    int64_t key;            // Offset to the key, 0 if the node has no key
+    union
+    {
+        int64_t offset;     // Offset to the string or to the children
+        double number;
+    } value;
+    uint32_t size;          // Length of the string or number of children
+    uint8_t type;
+    uint8_t flags;
+};
+
+typedef struct
+{
+    buffer_t *buffer;
+    map_t *keys;            // Offsets of the keys already written
+    // Iterables whose children are not written yet
+    struct { const json_t *node; size_t at; } *pending;
+    size_t size, room;
+} builder_t;
+
+#define VIEW_AT(builder, at) ((struct json_view *)(void *)((builder)->buffer->text + (at)))
+
+static int align(buffer_t *buffer)
+{
+    size_t pad = (8 - buffer->length % 8) % 8;
+
+    return (pad == 0) || buffer_repeat(buffer, '\0', pad);
+}
+
+/* Appends a '\0' terminated text, returns its offset in the buffer or 0 */
+static size_t write_text(buffer_t *buffer, const char *str, size_t length)
+{
+    size_t offset = buffer->length;
+
+    return buffer_append(buffer, str, length + 1) ? offset : 0;
+}
+
+static size_t write_key(builder_t *builder, const char *key)
+{
+    size_t offset = (size_t)(uintptr_t)map_search(builder->keys, key);
+
+    if (offset == 0)
+    {
+        offset = write_text(builder->buffer, key, strlen(key));
+        if ((offset == 0) ||
+            !map_insert(builder->keys, key, (void *)(uintptr_t)offset))
+        {
+            return 0;
+        }
+    }
+    return offset;
+}
+
+static int push(builder_t *builder, const json_t *node, size_t at)
+{
+    if (builder->size == builder->room)
+    {
+        size_t room = builder->room ? builder->room * 2 : 32;
+        void *pending = realloc(builder->pending, sizeof(*builder->pending) * room);
+
+        if (pending == NULL)
+        {
+            return 0;
+        }
+        builder->pending = pending;
+        builder->room = room;
+    }
+    builder->pending[builder->size].node = node;
+    builder->pending[builder->size].at = at;
+    builder->size++;
+    return 1;
+}
+
+/* Fills the record at offset 'at' (already zeroed) */
+static int write_node(builder_t *builder, size_t at, const json_t *node)
+{
+    size_t key = 0, string = 0, length = 0;
+
+    if ((node->key != NULL) && !(key = write_key(builder, node->key)))
+    {
+        return 0;
+    }
+    if (node->type == JSON_STRING)
+    {
+        length = strlen(node->string);
+        if ((length > UINT32_MAX) ||
+            !(string = write_text(builder->buffer, node->string, length)))
+        {
+            return 0;
+        }
+    }
+
+    struct json_view *view = VIEW_AT(builder, at);
+
+    view->key = key ? (int64_t)key - (int64_t)at : 0;
+    view->type = (uint8_t)node->type;
+    switch (node->type)
+    {
+        case JSON_OBJECT:
+        case JSON_ARRAY:
+            view->size = node->size;
+            return (node->size == 0) || push(builder, node, at);
+        case JSON_STRING:
+            view->value.offset = (int64_t)(string - at);
+            view->size = (uint32_t)length;
+            return 1;
+        case JSON_INTEGER:
+        case JSON_REAL:
+            view->value.number = node->number;
+            return 1;
+        default:
+            return 1;
+    }
+}
+
+struct entry { const char *key; uint32_t index; };
+
+static int compare_entries(const void *pa, const void *pb)
+{
+    const struct entry *a = pa;
+    const struct entry *b = pb;
+    int result = strcmp(a->key, b->key);
+
+    if (result == 0)
+    {
+        // Stable, the first of duplicated keys is found
+        return (a->index > b->index) - (a->index < b->index);
+    }
+    return result;
+}
+
+/* Appends the indexes of the members of an object sorted by key */
+static int write_index(buffer_t *buffer, const json_t *node)
+{
+    struct entry *entries = malloc(sizeof(*entries) * node->size);
+
+    if (entries == NULL)
+    {
+        return 0;
+    }
+    for (uint32_t index = 0; index < node->size; index++)
+    {
+        entries[index].key = node->child[index]->key;
+        entries[index].index = index;
+    }
+    qsort(entries, node->size, sizeof(*entries), compare_entries);
+
+    int rc = 1;
+
+    for (unsigned i = 0; rc && (i < node->size); i++)
+    {
+        rc = buffer_append(buffer, (const char *)&entries[i].index,
+            sizeof entries[i].index) != NULL;
+    }
+    free(entries);
+    return rc;
+}
+
+/* Writes the block of children of the iterable at offset 'at' */
+static int write_children(builder_t *builder, const json_t *node, size_t at)
+{
+    CHECK(align(builder->buffer));
+
+    size_t block = builder->buffer->length;
+
+    CHECK(buffer_repeat(builder->buffer, '\0', sizeof(struct json_view) * node->size));
+    if ((node->type == JSON_OBJECT) && (node->size >= JSON_KEYMAP_MIN))
+    {
+        CHECK(write_index(builder->buffer, node));
+        VIEW_AT(builder, at)->flags |= VIEW_SORTED;
+    }
+    VIEW_AT(builder, at)->value.offset = (int64_t)(block - at);
+    for (unsigned i = 0; i < node->size; i++)
+    {
+        CHECK(write_node(builder, block + sizeof(struct json_view) * i, node->child[i]));
+    }
+    return 1;
+}
+
+static int build(builder_t *builder, const json_t *node, size_t start)
+{
+    struct json_view_header header =
+    {
+        .magic = VIEW_MAGIC,
+        .version = VIEW_VERSION,
+        .order = VIEW_ORDER
+    };
+    size_t root = start + sizeof header;
+
+    CHECK(buffer_append(builder->buffer, (const char *)&header, sizeof header));
+    CHECK(buffer_repeat(builder->buffer, '\0', sizeof(struct json_view)));
+    CHECK(write_node(builder, root, node));
+    while (builder->size > 0)
+    {
+        builder->size--;
+        CHECK(write_children(builder, builder->pending[builder->size].node,
+                                      builder->pending[builder->size].at));
+    }
+    CHECK(align(builder->buffer));
+
+    uint64_t length = builder->buffer->length - start;
+
+    memcpy(builder->buffer->text + start + offsetof(struct json_view_header, length),
+        &length, sizeof length);
+    return 1;
+}
+
+/**
+ * Appends the view image of a tree to 'buffer' and returns a pointer to the
+ * image, the image starts at the next multiple of 8 of 'buffer->length'
+ * Pass the result to json_view_root() to navigate it
+ */
+char *json_view_encode(buffer_t *buffer, const json_t *node)
+{
+    if ((buffer == NULL) || (node == NULL))
+    {
+        return NULL;
+    }
+    if (!align(buffer))
+    {
+        return NULL;
+    }
+
+    builder_t builder = { .buffer = buffer, .keys = map_create(0) };
+    size_t start = buffer->length;
+    int rc = (builder.keys != NULL) && build(&builder, node, start);
+
+    map_destroy(builder.keys, NULL);
+    free(builder.pending);
+    if (!rc)
+    {
+        return NULL;
+    }
+    return buffer->text + start;
+}
+
+/* Writes the view image of a tree to a file */
+int json_view_write_file(const json_t *node, const char *path)
+{
+    if ((node == NULL) || (path == NULL))
+    {
+        return 0;
+    }
+
+    buffer_t buffer = { 0 };
+    const struct json_view_header *header = (const void *)json_view_encode(&buffer, node);
+    int rc = (header != NULL) && file_write_bytes(path, (const char *)header, header->length);
+
+    free(buffer.text);
+    return rc;
+}
+
+/**
+ * Returns the root of an image of 'length' bytes, or NULL if it is not an
+ * image of this version written in the byte order of the host
+ * The image must be aligned to 8 bytes (buffers and mapped files are)
+ */
+const json_view_t *json_view_root(const char *image, size_t length)
+{
+    if ((image == NULL) || ((uintptr_t)image % 8 != 0) ||
+        (length < sizeof(struct json_view_header) + sizeof(struct json_view)))
+    {
+        return NULL;
+    }
+
+    const struct json_view_header *header = (const void *)image;
+
+    if ((memcmp(header->magic, VIEW_MAGIC, sizeof header->magic) != 0) ||
+        (header->version != VIEW_VERSION) ||
+        (header->order != VIEW_ORDER) ||
+        (header->length > length))
+    {
+        return NULL;
+    }
+    return (const json_view_t *)(header + 1);
+}
+
+/* Maps an image file, the pages are loaded as the view is navigated */
+const json_view_t *json_view_map(const char *path)
+{
+    if (path == NULL)
+    {
+        return NULL;
+    }
+
+    size_t length = 0;
+    const char *image = file_map_random(path, &length);
+    const json_view_t *root = json_view_root(image, length);
+
+    if ((root == NULL) ||
+        (((const struct json_view_header *)(const void *)image)->length != length))
+    {
+        file_unmap(image, length);
+        return NULL;
+    }
+    return root;
+}
+
+/* Unmaps an image returned by json_view_map */
+void json_view_unmap(const json_view_t *root)
+{
+    if (root != NULL)
+    {
+        const struct json_view_header *header = (const void *)root;
+
+        header--;
+        file_unmap((const char *)header, header->length);
+    }
+}
+
+static const char *view_text(const json_view_t *view, int64_t offset)
+{
+    return (const char *)view + offset;
+}
+
+static const json_view_t *view_children(const json_view_t *view)
+{
+    return (const void *)((const char *)view + view->value.offset);
+}
+
+enum json_type json_view_type(const json_view_t *view)
+{
+    return view ? (enum json_type)view->type : JSON_UNDEFINED;
+}
+
+const char *json_view_key(const json_view_t *view)
+{
+    return view && view->key ? view_text(view, view->key) : NULL;
+}
+
+const char *json_view_string(const json_view_t *view)
+{
+    if ((view != NULL) && (view->type == JSON_STRING))
+    {
+        return view_text(view, view->value.offset);
+    }
+    return NULL;
+}
+
+const char *json_view_text(const json_view_t *view)
+{
+    if ((view != NULL) && (view->type == JSON_STRING))
+    {
+        return view_text(view, view->value.offset);
+    }
+    return "";
+}
+
+double json_view_number(const json_view_t *view)
+{
+    if ((view != NULL) && (view->type & JSON_NUMBER))
+    {
+        return view->value.number;
+    }
+    return 0.0;
+}
+
+int json_view_boolean(const json_view_t *view)
+{
+    return (view != NULL) && (view->type == JSON_TRUE);
+}
+
+unsigned json_view_size(const json_view_t *view)
+{
+    if ((view != NULL) && (view->type & JSON_ITERABLE))
+    {
+        return view->size;
+    }
+    return 0;
+}
+
+const json_view_t *json_view_at(const json_view_t *view, size_t index)
+{
+    if ((view != NULL) && (view->type & JSON_ITERABLE) && (index < view->size))
+    {
+        return view_children(view) + index;
+    }
+    return NULL;
+}
+
+/* Compares a key with the first 'length' bytes of 'str' */
+static int compare_key(const char *key, const char *str, size_t length)
+{
+    int result = strncmp(key, str, length);
+
+    return result ? result : key[length] != '\0';
+}
+
+/* Binary search on the sorted indexes, the first of duplicated keys wins */
+static const json_view_t *search_key(const json_view_t *view, const char *str,
+    size_t length)
+{
+    const json_view_t *child = view_children(view);
+    const uint32_t *index = (const void *)(child + view->size);
+    size_t lo = 0, hi = view->size;
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (compare_key(json_view_key(child + index[mid]), str, length) < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    if ((lo < view->size) && (compare_key(json_view_key(child + index[lo]), str, length) == 0))
+    {
+        return child + index[lo];
+    }
+    return NULL;
+}
+
+static const json_view_t *find_key(const json_view_t *view, const char *str,
+    size_t length)
+{
+    if (view->flags & VIEW_SORTED)
+    {
+        return search_key(view, str, length);
+    }
+
+    const json_view_t *child = view_children(view);
+
+    for (unsigned index = 0; index < view->size; index++)
+    {
+        if (compare_key(json_view_key(child + index), str, length) == 0)
+        {
+            return child + index;
+        }
+    }
+    return NULL;
+}
+
+const json_view_t *json_view_find(const json_view_t *view, const char *key)
+{
+    if ((view != NULL) && (view->type == JSON_OBJECT) && (key != NULL))
+    {
+        return find_key(view, key, strlen(key));
+    }
+    return NULL;
+}
+
+/* Same as compare() in json_pointer.c, '~0' and '~1' in 'path' are '~' and '/' */
+static int compare_escaped(const char *key, const char *path, const char *end)
+{
+    for (; path < end; key++, path++)
+    {
+        if (*key == '~')
+        {
+            if ((*path != '~') || (*++path != '0'))
+            {
+                return 0;
+            }
+        }
+        else if (*key == '/')
+        {
+            if ((*path != '~') || (*++path != '1'))
+            {
+                return 0;
+            }
+        }
+        else if (*key != *path)
+        {
+            return 0;
+        }
+    }
+    return *key == '\0';
+}
+
+static const json_view_t *pointer_key(const json_view_t *view, const char *path,
+    const char *end)
+{
+    if (!memchr(path, '~', (size_t)(end - path)))
+    {
+        return find_key(view, path, (size_t)(end - path));
+    }
+
+    const json_view_t *child = view_children(view);
+
+    for (unsigned index = 0; index < view->size; index++)
+    {
+        if (compare_escaped(json_view_key(child + index), path, end))
+        {
+            return child + index;
+        }
+    }
+    return NULL;
+}
+
+static const json_view_t *pointer_index(const json_view_t *view, const char *path,
+    const char *end)
+{
+    if ((path == end) || (path + strspn(path, "0123456789") != end))
+    {
+        return NULL;
+    }
+
+    unsigned long index = strtoul(path, NULL, 10);
+
+    return json_view_at(view, index);
+}
+
+/* Locates a node by JSON Pointer (see json_pointer.c) */
+const json_view_t *json_view_pointer(const json_view_t *view, const char *path)
+{
+    if ((view == NULL) || (path == NULL) || ((path[0] != '/') && (path[0] != '\0')))
+    {
+        return NULL;
+    }
+    if (path[0] == '\0')
+    {
+        return view;
+    }
+    path++;
+    while (view != NULL)
+    {
+        const char *end = path + strcspn(path, "/");
+
+        if (view->type == JSON_OBJECT)
+        {
+            view = pointer_key(view, path, end);
+        }
+        else if (view->type == JSON_ARRAY)
+        {
+            view = pointer_index(view, path, end);
+        }
+        else
+        {
+            return NULL;
+        }
+        if (*end != '/')
+        {
+            return view;
+        }
+        path = end + 1;
+    }
+    return NULL;
+}
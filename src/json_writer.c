@@ -13,6 +13,7 @@
 #include "json_private.h"
 #include "json_reader.h"
 #include "json_writer.h"
+#include "json_keys.h"
 
 /* Returns a new allocated json object */
 json_t *json_new_object(void)
@@ -38,7 +39,11 @@ json_t *json_new_array(void)
     return node;
 }
 
-/* Returns a new allocated json string */
+/**
+ * Returns a new allocated json string
+ * The text is stored right after the node (a single allocation), it is flagged
+ * as borrowed and released along with the node
+ */
 json_t *json_new_string(const char *str)
 {
     if (str == NULL)
@@ -46,23 +51,13 @@ json_t *json_new_string(const char *str)
         return NULL;
     }
 
-    char *string = string_clone(str);
-
-    if (string == NULL)
-    {
-        return NULL;
-    }
-
-    json_t *node = calloc(1, sizeof *node);
+    size_t size = strlen(str) + 1;
+    json_t *node = malloc(sizeof(*node) + size);
 
     if (node != NULL)
     {
-        node->type = JSON_STRING;
-        node->string = string;
-    }
-    else
-    {
-        free(string);
+        *node = (json_t){ .packed = JSON_BORROWED_STRING, .type = JSON_STRING };
+        node->string = memcpy(node + 1, str, size);
     }
     return node;
 }
@@ -157,34 +152,204 @@ json_t *json_new_null(void)
     return node;
 }
 
+/* Releases a key given the bits of 'packed' describing its storage */
+static void drop_key(char *key, unsigned char packed)
+{
+    if (packed & JSON_BORROWED_KEY)
+    {
+        return;
+    }
+    if (packed & JSON_KEYED)
+    {
+        free(json_keyref_of(key));
+    }
+    else
+    {
+        free(key);
+    }
+}
+
+/* Releases the key if it is owned by the node */
+static void free_key(json_t *node)
+{
+    drop_key(node->key, node->packed);
+    node->packed = (unsigned char)(node->packed & ~(JSON_BORROWED_KEY | JSON_KEYED));
+    node->key = NULL;
+}
+
+/* Unlinks a member leaving an indexed object from its parent */
+static void unlink_key(json_t *node)
+{
+    if (node->packed & JSON_KEYED)
+    {
+        json_keyref_of(node->key)->parent = NULL;
+    }
+}
+
+/* Releases the string if it is owned by the node */
+static void free_string(json_t *node)
+{
+    if (!(node->packed & JSON_BORROWED_STRING))
+    {
+        free(node->string);
+    }
+    node->packed = (unsigned char)(node->packed & ~JSON_BORROWED_STRING);
+    node->string = NULL;
+}
+
+/* Start of the allocation of the children (after the keymap on indexed objects) */
+static json_t **child_block(const json_t *node)
+{
+    return node->packed & JSON_INDEXED ? node->child - 1 : node->child;
+}
+
+/* Releases the array of children if it is owned by the node */
+static void free_child(json_t *node)
+{
+    if (node->packed & JSON_INDEXED)
+    {
+        json_keymap_destroy(node);
+    }
+    if (!(node->packed & JSON_BORROWED_CHILD))
+    {
+        free(child_block(node));
+    }
+    node->packed = (unsigned char)(node->packed & ~(JSON_BORROWED_CHILD | JSON_INDEXED));
+    node->child = NULL;
+}
+
+/* Grows the array of children of 'node' to 'size' nodes */
+static int grow_child(json_t *node, size_t size)
+{
+    size_t header = node->packed & JSON_INDEXED ? 1 : 0;
+    json_t **block = realloc(node->child ? child_block(node) : NULL,
+                             sizeof(*block) * (size + header));
+
+    if (block == NULL)
+    {
+        return 0;
+    }
+    node->child = block + header;
+    return 1;
+}
+
+/* Keeps the keymap of an object up to date after inserting a child at 'index' */
+static void index_child(json_t *node, unsigned index)
+{
+    if (node->packed & JSON_INDEXED)
+    {
+        json_keymap_insert(node, index);
+    }
+    else if ((node->type == JSON_OBJECT) && (node->size >= JSON_KEYMAP_MIN))
+    {
+        // On failure the object is still usable without an index
+        json_keymap_attach(node, next_pow2(node->size));
+    }
+}
+
+/**
+ * Borrowed arrays of children (e.g. allocated in an arena) have no room to grow,
+ * copy them into an owned array before inserting new nodes.
+ */
+static int own_child(json_t *node)
+{
+    if (!(node->packed & JSON_BORROWED_CHILD))
+    {
+        return 1;
+    }
+    if (node->size == 0)
+    {
+        free_child(node);
+        return 1;
+    }
+
+    size_t header = node->packed & JSON_INDEXED ? 1 : 0;
+    json_t **block = malloc(sizeof(*block) * (next_pow2(node->size) + header));
+
+    if (block == NULL)
+    {
+        return 0;
+    }
+    memcpy(block + header, node->child, sizeof(*block) * node->size);
+    node->packed = (unsigned char)(node->packed & ~JSON_BORROWED_CHILD);
+    node->child = block + header;
+    // The keymap was borrowed along with the children
+    if (header && !(json_keymap_of(node) = json_keymap_create(node, node->size, NULL)))
+    {
+        memmove(block, block + 1, sizeof(*block) * node->size);
+        node->packed = (unsigned char)(node->packed & ~JSON_INDEXED);
+        node->child = block;
+    }
+    return 1;
+}
+
+/**
+ * Returns a copy of 'str' in a keyref or the interned copy if a table of keys
+ * is set, 'packed' is set to the bits describing the storage of the key:
+ * JSON_KEYED or JSON_BORROWED_KEY for interned keys (see json_keys.c)
+ */
+static char *new_key(const char *str, unsigned char *packed)
+{
+    json_keys_t *keys = json_get_keys();
+    size_t length = strlen(str);
+
+    if (keys != NULL)
+    {
+        *packed = JSON_BORROWED_KEY;
+        return json_keys_intern(keys, str, length);
+    }
+
+    struct json_keyref *ref = malloc(sizeof(*ref) + length + 1);
+
+    if (ref == NULL)
+    {
+        return NULL;
+    }
+    ref->parent = NULL;
+    *packed = JSON_KEYED;
+    return memcpy(ref->key, str, length + 1);
+}
+
 /* Modifies/sets the key and returns itself */
 json_t *json_set_key(json_t *node, const char *str)
 {
-    if ((node == NULL) || (str == NULL) || (node->packed && !node->key))
+    if ((node == NULL) || (str == NULL) || ((node->packed & JSON_PACKED) && !node->key))
     {
         return NULL;
     }
 
-    char *key = string_clone(str);
+    unsigned char packed;
+    char *key = new_key(str, &packed);
 
     if (key == NULL)
     {
         return NULL;
     }
-    free(node->key);
+
+    // Members of indexed objects are moved to the slot of the new key
+    json_t *parent = node->packed & JSON_KEYED ? json_keyref_of(node->key)->parent : NULL;
+    unsigned index = parent && (parent->packed & JSON_INDEXED)
+        ? json_keymap_unlink(parent, node)
+        : JSON_NOT_FOUND;
+
+    free_key(node);
     node->key = key;
+    node->packed |= packed;
+    if (index != JSON_NOT_FOUND)
+    {
+        json_keymap_link(parent, index);
+    }
     return node;
 }
 
 /* Removes the key and returns itself */
 json_t *json_unset_key(json_t *node)
 {
-    if (!node || node->packed)
+    if (!node || (node->packed & JSON_PACKED))
     {
         return NULL;
     }
-    free(node->key);
-    node->key = NULL;
+    free_key(node);
     return node;
 }
 
@@ -198,8 +363,7 @@ static void clear(json_t *node)
             json_delete_children(node);
             break;
         case JSON_STRING:
-            free(node->string);
-            node->string = NULL;
+            free_string(node);
             break;
         case JSON_INTEGER:
         case JSON_REAL:
@@ -245,6 +409,7 @@ json_t *json_set_string(json_t *node, const char *str)
         return NULL;
     }
     clear(node);
+    node->packed = (unsigned char)(node->packed & ~JSON_BORROWED_STRING);
     node->type = JSON_STRING;
     node->string = string;
     return node;
@@ -271,6 +436,7 @@ json_t *json_set_format(json_t *node, const char *fmt, ...)
         return NULL;
     }
     clear(node);
+    node->packed = (unsigned char)(node->packed & ~JSON_BORROWED_STRING);
     node->type = JSON_STRING;
     node->string = string;
     return node;
@@ -341,7 +507,7 @@ json_t *json_set_flags(json_t *node, unsigned short flags)
 static json_t *push(json_t *parent, unsigned index, const char *name, json_t *child)
 {
     // Can't push itself nor a node with parent
-    if ((parent == child) || child->packed)
+    if ((parent == child) || (child->packed & JSON_PACKED))
     {
         return NULL;
     }
@@ -355,9 +521,10 @@ static json_t *push(json_t *parent, unsigned index, const char *name, json_t *ch
         index = parent->size;
     }
 
+    unsigned char packed = 0;
     char *key = NULL;
 
-    if ((name != NULL) && !(key = string_clone(name)))
+    if ((name != NULL) && !(key = new_key(name, &packed)))
     {
         return NULL;
     }
@@ -365,16 +532,13 @@ static json_t *push(json_t *parent, unsigned index, const char *name, json_t *ch
     // Space for inner nodes is incremented when size is a power of 2
     unsigned size = next_size(parent->size);
 
-    if (size > parent->size)
+    if (!own_child(parent) || ((size > parent->size) && !grow_child(parent, size)))
     {
-        json_t **temp = realloc(parent->child, sizeof(*temp) * size);
-
-        if (temp == NULL)
+        if (key != NULL)
         {
-            free(key);
-            return NULL;
+            drop_key(key, packed);
         }
-        parent->child = temp;
+        return NULL;
     }
     if (index < parent->size)
     {
@@ -384,12 +548,14 @@ static json_t *push(json_t *parent, unsigned index, const char *name, json_t *ch
     }
     if ((parent->type == JSON_ARRAY) || (key != NULL))
     {
-        free(child->key);
+        free_key(child);
         child->key = key;
+        child->packed |= packed;
     }
-    child->packed = 1;
+    child->packed |= JSON_PACKED;
     parent->child[index] = child;
     parent->size++;
+    index_child(parent, index);
     return child;
 }
 
@@ -451,18 +617,22 @@ static json_t *pop(json_t *parent, unsigned index)
 
     json_t *child = parent->child[index];
 
+    if (parent->packed & JSON_INDEXED)
+    {
+        json_keymap_remove(parent, index);
+    }
     if (index < parent->size - 1)
     {
         memmove(parent->child + index,
                 parent->child + index + 1,
-                sizeof(*parent->child) * (parent->size - index));
+                sizeof(*parent->child) * (parent->size - index - 1));
     }
     if (--parent->size == 0)
     {
-        free(parent->child);
-        parent->child = NULL;
+        free_child(parent);
     }
-    child->packed = 0;
+    child->packed = (unsigned char)(child->packed & ~JSON_PACKED);
+    unlink_key(child);
     return child;
 }
 
@@ -505,18 +675,16 @@ static json_t *move(json_t *source, unsigned source_index, json_t *target, unsig
     {
         index = target->size;
     }
+    if (!own_child(target))
+    {
+        return NULL;
+    }
 
     unsigned size = next_size(target->size);
 
-    if (size > target->size)
+    if ((size > target->size) && !grow_child(target, size))
     {
-        json_t **temp = realloc(target->child, sizeof(*temp) * size);
-
-        if (temp == NULL)
-        {
-            return NULL;
-        }
-        target->child = temp;
+        return NULL;
     }
     if (index < target->size)
     {
@@ -529,12 +697,12 @@ static json_t *move(json_t *source, unsigned source_index, json_t *target, unsig
 
     if (target->type != source->type)
     {
-        free(child->key);
-        child->key = NULL;
+        free_key(child);
     }
-    child->packed = 1;
+    child->packed |= JSON_PACKED;
     target->child[index] = child;
     target->size++;
+    index_child(target, index);
     return child;
 }
 
@@ -565,6 +733,10 @@ static json_t *move_from_to(json_t *parent, unsigned a, unsigned b)
                 sizeof(*parent->child) * (b - a));
     }
     parent->child[b] = temp;
+    if (parent->packed & JSON_INDEXED)
+    {
+        json_keymap_reset(parent);
+    }
     return temp;
 }
 
@@ -618,6 +790,17 @@ json_t *json_swap(json_t *source, size_t a, json_t *target, size_t b)
 
         source->child[a] = target->child[b];
         target->child[b] = temp;
+        // Linked again by the refills of indexed objects
+        unlink_key(source->child[a]);
+        unlink_key(temp);
+        if (source->packed & JSON_INDEXED)
+        {
+            json_keymap_reset(source);
+        }
+        if ((target != source) && (target->packed & JSON_INDEXED))
+        {
+            json_keymap_reset(target);
+        }
         return temp;
     }
     return NULL;
@@ -646,31 +829,64 @@ static void delete_node(json_t *node)
 {
     if (node->type == JSON_STRING)
     {
-        free(node->string);
+        free_string(node);
     }
     else if (node->size > 0)
     {
-        free(node->child);
+        free_child(node);
+    }
+    free_key(node);
+    if (node->packed & JSON_DOCUMENT)
+    {
+        free(((struct json_document *)node)->source);
+    }
+    if (!(node->packed & JSON_BORROWED_NODE))
+    {
+        free(node);
     }
-    free(node->key);
-    free(node);
 }
 
-/* json_delete recursive helper */
+/**
+ * json_delete helper, the tree is released in post-order without a stack:
+ * children are released from the back (shrinking 'size') and the key of an
+ * inner node, released when entering the node, links back to its parent
+ */
 static void delete_tree(json_t *node)
 {
-    for (unsigned i = 0; i < node->size; i++)
+    if (node->size == 0)
     {
-        if (node->child[i]->size > 0)
+        delete_node(node);
+        return;
+    }
+    free_key(node);
+    for (;;)
+    {
+        if (node->size > 0)
         {
-            delete_tree(node->child[i]);
+            json_t *child = node->child[--node->size];
+
+            if (child->size == 0)
+            {
+                delete_node(child);
+                continue;
+            }
+            free_key(child);
+            child->key = (char *)(void *)node;
+            node = child;
+            continue;
         }
-        else
+
+        json_t *parent = (json_t *)(void *)node->key;
+
+        node->key = NULL;
+        free_child(node);
+        delete_node(node);
+        if (parent == NULL)
         {
-            delete_node(node->child[i]);
+            return;
         }
+        node = parent;
     }
-    delete_node(node);
 }
 
 /* Deletes internal nodes */
@@ -689,7 +905,7 @@ int json_delete_children(json_t *node)
     }
     if (node->size > 0)
     {
-        node->child = NULL;
+        free_child(node);
         node->size = 0;
         return 1;
     }
@@ -702,7 +918,7 @@ int json_delete_children(json_t *node)
  */
 int json_delete(json_t *node)
 {
-    if (!node || node->packed)
+    if (!node || (node->packed & JSON_PACKED))
     {
         return 0;
     }
@@ -716,7 +932,7 @@ int json_delete(json_t *node)
  */
 void json_free(void *node)
 {
-    if (!node || ((json_t *)node)->packed)
+    if (!node || (((json_t *)node)->packed & JSON_PACKED))
     {
         return;
     }
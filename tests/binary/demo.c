@@ -0,0 +1,81 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <math.h>
+#include <clux/json.h>
+
+/* -0 has no MessagePack integer format, it must keep its sign as a float64 */
+static void negative_zero(void)
+{
+    json_t *node = json_new_integer(-0.0);
+    buffer_t buffer = {0};
+
+    if ((node == NULL) || !json_encode_binary(&buffer, node))
+    {
+        perror("json_encode_binary");
+        exit(EXIT_FAILURE);
+    }
+
+    json_t *copy = json_decode_binary(buffer.text, buffer.length);
+
+    free(buffer.text);
+    printf("Round trip of -0 %s\n",
+        copy && (json_number(copy) == 0) && signbit(json_number(copy)) ? "ok" : "failed");
+    json_delete(node);
+    json_delete(copy);
+}
+
+int main(int argc, char *argv[])
+{
+    setlocale(LC_NUMERIC, "C");
+
+    json_error_t error;
+    json_t *node = json_parse_file(argc > 1 ? argv[1] : "test.json", &error);
+
+    if (node == NULL)
+    {
+        json_print_error(&error);
+        exit(EXIT_FAILURE);
+    }
+
+    buffer_t buffer = {0};
+
+    if (!json_encode_binary(&buffer, node))
+    {
+        perror("json_encode_binary");
+        exit(EXIT_FAILURE);
+    }
+
+    char *text = json_encode(node, 0);
+
+    if (text == NULL)
+    {
+        perror("json_encode");
+        exit(EXIT_FAILURE);
+    }
+    printf("%zu bytes as text, %zu bytes as MessagePack\n", strlen(text), buffer.length);
+    free(text);
+
+    // Integers and reals keep their types in a round trip
+    json_t *copy = json_decode_binary(buffer.text, buffer.length);
+
+    free(buffer.text);
+    if (copy == NULL)
+    {
+        fprintf(stderr, "json_decode_binary: invalid data\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("Round trip %s\n", json_equal(node, copy) > 0 ? "ok" : "failed");
+    json_print(copy);
+    json_delete(node);
+    json_delete(copy);
+    negative_zero();
+    return 0;
+}
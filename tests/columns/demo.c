@@ -0,0 +1,68 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+#include <stdlib.h>
+#include <locale.h>
+#include <clux/json.h>
+
+/* Average of "v" over the rows where "id" is "cpu", scanning two columns */
+static void print_average(const json_columns_t *columns)
+{
+    const unsigned *ids = json_columns_ids(columns, json_columns_index(columns, "id"));
+    const double *values = json_columns_numbers(columns, json_columns_index(columns, "v"));
+    unsigned cpu = json_columns_lookup(columns, "cpu");
+    size_t rows = json_columns_rows(columns);
+    double sum = 0;
+    size_t count = 0;
+
+    if ((ids == NULL) || (values == NULL))
+    {
+        return;
+    }
+    for (size_t row = 0; row < rows; row++)
+    {
+        if (ids[row] == cpu)
+        {
+            sum += values[row];
+            count++;
+        }
+    }
+    printf("cpu: %zu rows, average %g\n", count, count ? sum / (double)count : 0);
+    printf("sum of v: %g\n", json_columns_sum(columns, json_columns_index(columns, "v")));
+}
+
+int main(int argc, char *argv[])
+{
+    setlocale(LC_NUMERIC, "C");
+
+    json_error_t error;
+    json_t *array = json_parse_file(argc > 1 ? argv[1] : "test.json", &error);
+
+    if (array == NULL)
+    {
+        json_print_error(&error);
+        exit(EXIT_FAILURE);
+    }
+
+    // The shape is taken from the first object
+    json_columns_t *columns = json_columns_create(array, NULL, 0);
+
+    json_delete(array);
+    if (columns == NULL)
+    {
+        fprintf(stderr, "The array can not be stored by columns\n");
+        exit(EXIT_FAILURE);
+    }
+    print_average(columns);
+
+    // And back to a tree
+    json_t *tree = json_columns_tree(columns);
+
+    json_columns_destroy(columns);
+    json_print(tree);
+    json_delete(tree);
+    return 0;
+}
@@ -34,27 +34,16 @@ curl -v -G "http://127.0.0.1:1234/api/users" --data-urlencode "name=John" --data
 
 enum method { GET, POST, PUT, PATCH, DELETE, METHODS };
 
-struct data { char *text; size_t length, size; };
+struct data { json_parser_t *parser; size_t length; };
 
 // cppcheck-suppress constParameterCallback
 static size_t copy_data(void *text, size_t sz, size_t elems, void *stream)
 {
     struct data *data = stream;
     size_t length = sz * elems;
-    size_t size = data->length + length + 1;
 
-    if (size > data->size)
-    {
-        char *temp = realloc(data->text, size);
-
-        if (temp == NULL)
-        {
-            return 0;
-        }
-        data->text = temp;
-        data->size = size;
-    }
-    ((char *)memcpy(data->text + data->length, text, length))[length] = '\0';
+    // Chunks are parsed as they arrive, errors are reported by json_parser_finish
+    json_parser_feed(data->parser, text, length);
     data->length += length;
     return length;
 }
@@ -140,6 +129,13 @@ static int request(size_t id, const json_t *users, struct data *data)
         perror("curl_easy_init");
         exit(EXIT_FAILURE);
     }
+    data->parser = json_parser_create();
+    data->length = 0;
+    if (data->parser == NULL)
+    {
+        perror("json_parser_create");
+        exit(EXIT_FAILURE);
+    }
 
     struct curl_slist *headers = NULL;
 
@@ -162,7 +158,7 @@ static int request(size_t id, const json_t *users, struct data *data)
     else if (data->length > 0)
     {
         json_error_t error;
-        json_t *node = json_parse(data->text, &error);
+        json_t *node = json_parser_finish(data->parser, &error);
 
         if (node == NULL)
         {
@@ -173,8 +169,8 @@ static int request(size_t id, const json_t *users, struct data *data)
             json_print(node);
             json_delete(node);
         }
-        data->length = 0;
     }
+    json_parser_destroy(data->parser);
     curl_slist_free_all(headers);
     curl_easy_cleanup(curl);
     return rc;
@@ -209,7 +205,6 @@ int main(void)
         }
     }
     json_delete(users);
-    free(data.text);
     return 0;
 }
 
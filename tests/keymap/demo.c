@@ -0,0 +1,104 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <clux/json.h>
+#include <clux/json_private.h>
+
+enum { size = 20000 };
+
+static void object_push_back(json_t *parent, const char *key, json_t *child)
+{
+    if (!json_object_push_back(parent, key, child))
+    {
+        json_delete(parent);
+        json_delete(child);
+        perror("object_push_back");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static json_t *new_dictionary(const char *prefix)
+{
+    json_t *object = json_new_object();
+
+    if (object == NULL)
+    {
+        perror("json_new_object");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < size; i++)
+    {
+        char key[32];
+
+        snprintf(key, sizeof key, "%s%d", prefix, i);
+        object_push_back(object, key, json_new_integer(i));
+    }
+    return object;
+}
+
+/* Returns the seconds spent searching all the keys of 'object' */
+static double search_all(const json_t *object, const char *prefix)
+{
+    clock_t start = clock();
+
+    for (int i = 0; i < size; i++)
+    {
+        char key[32];
+
+        snprintf(key, sizeof key, "%s%d", prefix, i);
+        if (json_number(json_find(object, key)) != i)
+        {
+            fprintf(stderr, "'%s' not found\n", key);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void set_key(json_t *node, const char *key)
+{
+    if (!json_set_key(node, key))
+    {
+        perror("json_set_key");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* A linear scan of each key would be orders of magnitude slower */
+static const char *lookups(double before, double after)
+{
+    return after <= before * 10 + 0.01 ? "hashed" : "linear";
+}
+
+int main(void)
+{
+    json_t *a = new_dictionary("a");
+    json_t *b = new_dictionary("b");
+
+    printf("Objects indexed: %s\n",
+        (a->packed & b->packed & JSON_INDEXED) ? "yes" : "no");
+
+    double before = search_all(b, "b");
+
+    set_key(json_find(a, "a100"), "renamed");
+    printf("Search 'renamed' in a: %g\n", json_number(json_find(a, "renamed")));
+    printf("Search 'a100' in a: %s\n", json_find(a, "a100") ? "found" : "not found");
+    printf("Searching b after renaming a key of a: %s\n",
+        lookups(before, search_all(b, "b")));
+    set_key(json_find(a, "renamed"), "a100");
+    printf("Searching a after renaming the key back: %s\n",
+        lookups(before, search_all(a, "a")));
+    // Reordering the members refills the map
+    json_reverse(a);
+    printf("Searching a after a refill: %s\n",
+        lookups(before, search_all(a, "a")));
+    json_delete(a);
+    json_delete(b);
+    return 0;
+}
@@ -19,6 +19,17 @@
 
 /* Print the size of a parsed JSON document in memory */
 
+/* Keys and strings can be stored in the same block of the node */
+static int is_inline(const json_t *node, const char *text)
+{
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-qual"
+    const char *block = (const char *)node;
+
+    return (text >= block) && (text < block + MALLOC_SIZE(node));
+#pragma GCC diagnostic pop
+}
+
 static int sum_memory_used(const json_t *node, size_t depth, void *data)
 {
     (void)depth;
@@ -27,11 +38,11 @@ static int sum_memory_used(const json_t *node, size_t depth, void *data)
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wcast-qual"
-    if (json_key(node) != NULL)
+    if ((json_key(node) != NULL) && !is_inline(node, json_key(node)))
     {
         size += MALLOC_SIZE(json_key(node));
     }
-    if (json_type(node) == JSON_STRING)
+    if ((json_type(node) == JSON_STRING) && !is_inline(node, json_string(node)))
     {
         size += MALLOC_SIZE(json_string(node));
     }
@@ -68,6 +79,14 @@ static void print_memory_used(const char *path)
         printf("File size: %zu bytes\nTree size: %zu bytes\n",
             file_size, tree_size);
         json_delete(node);
+
+        json_arena_t arena = { 0 };
+
+        if (json_parse_arena(file, &arena, NULL) != NULL)
+        {
+            printf("Arena size: %zu bytes\n", arena_used(&arena));
+        }
+        arena_clear(&arena);
     }
     else
     {
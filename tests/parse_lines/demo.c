@@ -4,70 +4,20 @@
  *  \copyright GNU Public License.
  */
 
-#define _POSIX_C_SOURCE 200809L
-
-#include <stdlib.h>
 #include <locale.h>
-#include <sys/types.h>
 #include <clux/json.h>
 
 static json_t *parse_lines(const char *path)
 {
-    FILE *file = fopen(path, "rb");
-
-    if (file == NULL)
-    {
-        perror("fopen");
-        return NULL;
-    }
-
-    // getline() buffer
-    char *str = NULL;
-
-    // Lines are packed into array
-    json_t *array = json_new_array();
-
-    if (array == NULL)
-    {
-        perror("json_new_array");
-        goto error;
-    }
-
     json_error_t error; // Error handle is optional
-    json_t *node;
+    // Lines are parsed in parallel and packed into an array in order
+    json_t *array = json_parse_lines_file(path, &error);
 
-    // getline() stuff
-    ssize_t length = 0;
-    size_t size = 0;
-    int line = 0;
-
-    while ((length = getline(&str, &size, file)) != -1)
+    if (array == NULL)
     {
-        line++;
-        if (length <= 1)
-        {
-            continue;
-        }
-        if ((node = json_parse(str, &error)) == NULL)
-        {
-            error.line = line;
-            fprintf(stderr, "%s\n", path);
-            json_print_error(&error);
-            goto error;
-        }
-        if (json_array_push_back(array, node) == NULL)
-        {
-            perror("json_array_push_back");
-            goto error;
-        }
+        fprintf(stderr, "%s\n", path);
+        json_print_error(&error);
     }
-    goto cleanup;
-error:
-    json_delete(array);
-    array = NULL;
-cleanup:
-    fclose(file);
-    free(str);
     return array;
 }
 
@@ -81,4 +31,3 @@ int main(int argc, char *argv[])
     json_free(node);
     return 0;
 }
-
@@ -64,10 +64,16 @@ static int on_validate(const json_event_t *event, void *buffer)
 
 static int validate(const json_t *rules, const json_t *entry)
 {
+    // Compiled once, a compiled schema can validate any number of entries
+    json_schema_t *schema = json_schema_compile(rules, NULL);
     buffer_t buffer = { 0 };
     int rc = EXIT_SUCCESS;
+    int valid = schema != NULL
+        ? json_schema_validate(schema, entry, on_validate, &buffer)
+        // Not compiled (malformed schema or out of memory), the interpreter reports why
+        : json_validate(rules, entry, NULL, on_validate, &buffer);
 
-    if (!json_validate(rules, entry, NULL, on_validate, &buffer))
+    if (!valid)
     {
         fprintf(stderr, "Doesn't validate against schema\n");
         rc = EXIT_FAILURE;
@@ -77,6 +83,7 @@ static int validate(const json_t *rules, const json_t *entry)
         fprintf(stderr, "Invalid rules:\n%s", buffer.text);
         free(buffer.text);
     }
+    json_schema_destroy(schema);
     return rc;
 }
 
@@ -0,0 +1,82 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <clux/json.h>
+
+/* Prints the names of all the members without building a tree */
+static void print_names(json_stream_t *stream, FILE *file)
+{
+    char chunk[256]; // Small chunks splitting tokens on purpose
+    int is_name = 0;
+
+    for (;;)
+    {
+        switch (json_stream_next(stream))
+        {
+            case JSON_TOKEN_MORE:
+            {
+                size_t bytes = fread(chunk, 1, sizeof chunk, file);
+
+                if (bytes > 0)
+                {
+                    json_stream_feed(stream, chunk, bytes);
+                }
+                else
+                {
+                    json_stream_finish(stream);
+                }
+                break;
+            }
+            case JSON_TOKEN_KEY:
+                is_name = !strcmp(json_stream_text(stream), "name");
+                break;
+            case JSON_TOKEN_STRING:
+                if (is_name)
+                {
+                    printf("%*s%s\n", (int)json_stream_depth(stream) * 2, "", json_stream_text(stream));
+                }
+                is_name = 0;
+                break;
+            case JSON_TOKEN_END:
+                return;
+            case JSON_TOKEN_ERROR:
+            {
+                json_error_t error;
+
+                json_stream_error(stream, &error);
+                json_print_error(&error);
+                return;
+            }
+            default:
+                is_name = 0;
+                break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : "test.json";
+    FILE *file = fopen(path, "rb");
+
+    if (file == NULL)
+    {
+        perror("fopen");
+        return 1;
+    }
+
+    json_stream_t *stream = json_stream_create();
+
+    if (stream != NULL)
+    {
+        print_names(stream, file);
+        json_stream_destroy(stream);
+    }
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,54 @@
+/*!
+ *  \brief     C library for unixes
+ *  \author    David Ranieri <davranfor@gmail.com>
+ *  \copyright GNU Public License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <locale.h>
+#include <clux/json.h>
+
+int main(int argc, char *argv[])
+{
+    setlocale(LC_NUMERIC, "C");
+
+    json_error_t error;
+    json_t *node = json_parse_file(argc > 1 ? argv[1] : "test.json", &error);
+
+    if (node == NULL)
+    {
+        json_print_error(&error);
+        exit(EXIT_FAILURE);
+    }
+
+    const char *path = "test.view";
+    int rc = json_view_write_file(node, path);
+
+    json_delete(node);
+    if (!rc)
+    {
+        perror("json_view_write_file");
+        exit(EXIT_FAILURE);
+    }
+
+    // The image is navigated in place, nothing is decoded
+    const json_view_t *root = json_view_map(path);
+
+    if (root == NULL)
+    {
+        fprintf(stderr, "%s is not a view\n", path);
+        exit(EXIT_FAILURE);
+    }
+    printf("name: %s\n", json_view_text(json_view_find(root, "name")));
+    printf("max: %g\n", json_view_number(json_view_pointer(root, "/limits/max")));
+
+    const json_view_t *tags = json_view_find(root, "tags");
+
+    for (unsigned i = 0; i < json_view_size(tags); i++)
+    {
+        printf("tag: %s\n", json_view_text(json_view_at(tags, i)));
+    }
+    json_view_unmap(root);
+    return 0;
+}